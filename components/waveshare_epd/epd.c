@@ -5,15 +5,22 @@
 
 // Simple software framebuffer and text cursor state
 static uint8_t framebuffer[EPD_ARRAY];
+static uint8_t *target = framebuffer;
 static int cursor_x = 0;
 static int cursor_y = 0;
 static uint8_t text_color = EPD_BLACK;
 static int text_size = 1;
 
+// Waveform the controller was last initialised for
+static bool panel_partial = false;
+static int partial_updates = 0;
+
 void epd_begin(void)
 {
     ws_epd_bus_init();
     ws_epd_init_full();
+    panel_partial = false;
+    partial_updates = 0;
     memset(framebuffer, 0x00, sizeof(framebuffer));
     Image_Init(framebuffer, EPD_WIDTH, EPD_HEIGHT, ROTATE_0, WHITE);
 }
@@ -25,24 +32,62 @@ void epd_clear(void)
 
 void epd_update(void)
 {
+    if (panel_partial) {
+        ws_epd_init_full();
+        panel_partial = false;
+    }
     ws_epd_write_full(framebuffer);
+    partial_updates = 0;
+}
+
+void epd_update_region(int x, int y, int w, int h)
+{
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > EPD_WIDTH) w = EPD_WIDTH - x;
+    if (y + h > EPD_HEIGHT) h = EPD_HEIGHT - y;
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    if (partial_updates >= EPD_PARTIAL_REFRESH_LIMIT) {
+        epd_update();
+        return;
+    }
+
+    // Window in framebuffer space, widened to whole bytes
+    int px = epd_framebuffer_mirrored() ? EPD_WIDTH - x - w : x;
+    int px_end = (px + w + 7) & ~7;
+    px &= ~7;
+
+    if (!panel_partial) {
+        ws_epd_init_partial();
+        panel_partial = true;
+    }
+    ws_epd_write_partial(framebuffer, px, y, px_end - px, h);
+    partial_updates++;
+}
+
+void epd_adopt_framebuffer(void)
+{
+    ws_epd_write_ram(framebuffer);
+    partial_updates = 0;
 }
 
 void epd_fill_screen(uint8_t color)
 {
-    Gui_SelectImage(framebuffer);
+    Gui_SelectImage(target);
     Gui_Clear(color);
 }
 
 void epd_fill_rect(int x, int y, int w, int h, uint8_t color)
 {
-    Gui_SelectImage(framebuffer);
+    Gui_SelectImage(target);
     Gui_Draw_Rectangle(x, y, x + w, y + h, color, FULL, PIXEL_1X1);
 }
 
 void epd_draw_rect(int x, int y, int w, int h, uint8_t color)
 {
-    Gui_SelectImage(framebuffer);
+    Gui_SelectImage(target);
     Gui_Draw_Rectangle(x, y, x + w, y + h, color, EMPTY, PIXEL_1X1);
 }
 
@@ -77,10 +122,35 @@ static FONT* font_for_size(int size)
 
 void epd_print(const char *s)
 {
-    Gui_SelectImage(framebuffer);
+    Gui_SelectImage(target);
     FONT *font = font_for_size(text_size);
     Gui_Draw_Str((uint16_t)cursor_x, (uint16_t)cursor_y, s, font, FONT_BACKGROUND, text_color);
 }
 
+uint8_t *epd_get_framebuffer(void)
+{
+    return framebuffer;
+}
+
+void epd_set_target(uint8_t *buf)
+{
+    target = buf ? buf : framebuffer;
+}
+
+uint8_t *epd_get_target(void)
+{
+    return target;
+}
+
+void epd_load_layer(const uint8_t *layer)
+{
+    memcpy(framebuffer, layer, sizeof(framebuffer));
+}
+
+bool epd_framebuffer_mirrored(void)
+{
+    return (Image.mirror & MIRROR_HORIZONTAL) != 0;
+}
+
 
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -12,9 +13,20 @@ extern "C" {
 #define EPD_WHITE 0x00
 #define EPD_RED   0x00 // Monochrome panel; treat red as white for now
 
+#ifndef EPD_PARTIAL_REFRESH_LIMIT
+#define EPD_PARTIAL_REFRESH_LIMIT 20
+#endif
+
 void epd_begin(void);
 void epd_clear(void);
 void epd_update(void);
+// Refresh only the given rectangle with the partial waveform. Every
+// EPD_PARTIAL_REFRESH_LIMIT partial updates a full refresh is done instead
+// to clear ghosting.
+void epd_update_region(int x, int y, int w, int h);
+// The panel still shows the framebuffer's content (restored after a reboot):
+// load it into the controller without a refresh so partial updates can follow
+void epd_adopt_framebuffer(void);
 
 // Minimal GFX-like drawing functions on software framebuffer
 void epd_fill_screen(uint8_t color);
@@ -25,6 +37,17 @@ void epd_set_text_color(uint8_t color);
 void epd_set_text_size(int size);
 void epd_print(const char *s);
 
+// Raw access to the packed 1bpp framebuffer (EPD_ARRAY bytes)
+uint8_t *epd_get_framebuffer(void);
+
+// Redirect drawing into another EPD_ARRAY sized buffer, NULL restores the framebuffer
+void epd_set_target(uint8_t *buf);
+// Buffer drawing currently goes to
+uint8_t *epd_get_target(void);
+// Overwrite the framebuffer with a pre-rendered layer
+void epd_load_layer(const uint8_t *layer);
+bool epd_framebuffer_mirrored(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,6 +4,7 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include <stddef.h>
 
 static const char *TAG = "WS_EPD";
 
@@ -12,6 +13,7 @@ static spi_device_handle_t epd_spi;
 
 static inline void ws_epd_write_cmd(uint8_t cmd);
 static inline void ws_epd_write_data(uint8_t data);
+static void ws_epd_write_data_buf(const uint8_t *data, size_t len);
 static inline void ws_epd_wait_busy(void);
 
 esp_err_t ws_epd_bus_init(void)
@@ -85,6 +87,17 @@ static inline void ws_epd_write_data(uint8_t data)
     spi_device_transmit(epd_spi, &t);
 }
 
+// Send a run of data bytes in one SPI transaction instead of one per byte
+static void ws_epd_write_data_buf(const uint8_t *data, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    gpio_set_level(EPD_PIN_DC, 1);
+    spi_transaction_t t = { .length = len * 8, .tx_buffer = data };
+    spi_device_transmit(epd_spi, &t);
+}
+
 static inline void ws_epd_wait_busy(void)
 {
     // Busy is asserted low on many controllers; use high=1 from Arduino port
@@ -199,6 +212,44 @@ void ws_epd_write_full(const uint8_t *framebuffer)
     ws_epd_update();
 }
 
+void ws_epd_write_ram(const uint8_t *framebuffer)
+{
+    ws_epd_write_cmd(0x10);
+    ws_epd_write_data_buf(framebuffer, EPD_ARRAY);
+    ws_epd_write_cmd(0x13);
+    ws_epd_write_data_buf(framebuffer, EPD_ARRAY);
+}
+
+void ws_epd_write_partial(const uint8_t *framebuffer, int x, int y, int w, int h)
+{
+    int x_end = x + w - 1;
+    int y_end = y + h - 1;
+
+    ws_epd_write_cmd(0x50); // VCOM AND DATA INTERVAL
+    ws_epd_write_data(0xA9);
+    ws_epd_write_data(0x07);
+
+    ws_epd_write_cmd(0x91); // PARTIAL IN
+    ws_epd_write_cmd(0x90); // PARTIAL WINDOW
+    ws_epd_write_data((uint8_t)(x >> 8));
+    ws_epd_write_data((uint8_t)(x & 0xFF));
+    ws_epd_write_data((uint8_t)(x_end >> 8));
+    ws_epd_write_data((uint8_t)(x_end & 0xFF));
+    ws_epd_write_data((uint8_t)(y >> 8));
+    ws_epd_write_data((uint8_t)(y & 0xFF));
+    ws_epd_write_data((uint8_t)(y_end >> 8));
+    ws_epd_write_data((uint8_t)(y_end & 0xFF));
+    ws_epd_write_data(0x01); // gates scan inside and outside the window
+
+    ws_epd_write_cmd(0x13); // New data, window rows only
+    for (int row = y; row <= y_end; row++) {
+        ws_epd_write_data_buf(&framebuffer[row * (EPD_WIDTH / 8) + x / 8], (size_t)(w / 8));
+    }
+    ws_epd_update();
+
+    ws_epd_write_cmd(0x92); // PARTIAL OUT
+}
+
 void ws_epd_clear_white(void)
 {
     ws_epd_write_cmd(0x10);
@@ -48,6 +48,11 @@ void ws_epd_init_partial(void);
 // Frame operations
 void ws_epd_update(void);
 void ws_epd_write_full(const uint8_t *framebuffer);   // write and refresh
+// Load the controller's old and new image RAM without refreshing
+void ws_epd_write_ram(const uint8_t *framebuffer);
+// Write and refresh a window using the partial waveform (needs ws_epd_init_partial).
+// Coordinates are in framebuffer (panel) space; x and w must be multiples of 8.
+void ws_epd_write_partial(const uint8_t *framebuffer, int x, int y, int w, int h);
 void ws_epd_clear_white(void);
 void ws_epd_clear_black(void);
 
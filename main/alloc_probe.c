@@ -0,0 +1,58 @@
+#include "alloc_probe.h"
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Task inside each scope, NULL if none. Written only by that task.
+static TaskHandle_t volatile scope_task[ALLOC_PROBE_SCOPES];
+static uint32_t counts[ALLOC_PROBE_SCOPES];
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static void alloc_probe_note(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (!self) {
+        return;
+    }
+    for (int i = 0; i < ALLOC_PROBE_SCOPES; i++) {
+        if (scope_task[i] == self) {
+            __atomic_fetch_add(&counts[i], 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void *__wrap_malloc(size_t size)
+{
+    alloc_probe_note();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    alloc_probe_note();
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    alloc_probe_note();
+    return __real_realloc(ptr, size);
+}
+
+void alloc_probe_enter(alloc_probe_scope_t scope)
+{
+    scope_task[scope] = xTaskGetCurrentTaskHandle();
+}
+
+void alloc_probe_exit(alloc_probe_scope_t scope)
+{
+    scope_task[scope] = NULL;
+}
+
+uint32_t alloc_probe_count(alloc_probe_scope_t scope)
+{
+    return __atomic_load_n(&counts[scope], __ATOMIC_RELAXED);
+}
@@ -0,0 +1,30 @@
+#ifndef ALLOC_PROBE_H
+#define ALLOC_PROBE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Counts heap allocations made on the message hot path, which should make
+// none. malloc, calloc and realloc are wrapped at link time (see
+// CMakeLists.txt); a call counts when the calling task is inside a scope.
+
+typedef enum {
+    ALLOC_PROBE_MQTT,       // MQTT data events, up to the mailbox post
+    ALLOC_PROBE_PARSE,      // render task applying mailbox payloads
+    ALLOC_PROBE_SCOPES,
+} alloc_probe_scope_t;
+
+// The current task enters or leaves scope. Scopes do not nest.
+void alloc_probe_enter(alloc_probe_scope_t scope);
+void alloc_probe_exit(alloc_probe_scope_t scope);
+
+uint32_t alloc_probe_count(alloc_probe_scope_t scope);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ALLOC_PROBE_H
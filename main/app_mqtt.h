@@ -1,9 +1,25 @@
 #ifndef APP_MQTT_H
 #define APP_MQTT_H
 
-void mqtt_app_start(void);
+#include <stdbool.h>
+#include <stdint.h>
 
-#endif // APP_MQTT_H
+typedef struct {
+    uint32_t messages;
+    uint32_t bytes;
+    uint32_t reassembled;           // messages larger than the receive buffer, put back together
+    uint32_t oversize;              // dropped, larger than the reassembly buffer
+    uint32_t unsupported;           // dropped, MQTT 5 content type the widgets cannot decode
+    uint32_t reassembly_errors;     // parts missing or out of order, their message is dropped
+    uint32_t subscribe_packets;
+    uint32_t resubscribes_skipped;  // reconnects that found the subscriptions in the broker's session
+} mqtt_stats_t;
 
+void mqtt_app_start(void);
 
+// Queue payload for topic at QoS 1, false if the client is not running
+bool mqtt_app_publish(const char *topic, const char *payload);
 
+void mqtt_app_get_stats(mqtt_stats_t *out);
+
+#endif // APP_MQTT_H
@@ -0,0 +1,41 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool arena_init(arena_t *arena, size_t size)
+{
+    arena->base = size ? (uint8_t *)calloc(1, size) : NULL;
+    arena->size = arena->base ? size : 0;
+    arena->used = 0;
+    return arena->base != NULL || size == 0;
+}
+
+void arena_free(arena_t *arena)
+{
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+    size_t start = arena_align(arena->used);
+    if (start > arena->size || size > arena->size - start) {
+        return NULL;
+    }
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+char *arena_strdup(arena_t *arena, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    if (len > arena->size - arena->used) {
+        return NULL;
+    }
+    char *copy = (char *)arena->base + arena->used;
+    memcpy(copy, s, len);
+    arena->used += len;
+    return copy;
+}
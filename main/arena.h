@@ -0,0 +1,41 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bump allocator over one heap block. Callers size the block up front from
+// what they are about to store, allocate out of it while building, and
+// release everything at once with arena_free(). Memory starts zeroed.
+
+#define ARENA_ALIGN 8
+
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+} arena_t;
+
+static inline size_t arena_align(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+bool arena_init(arena_t *arena, size_t size);
+void arena_free(arena_t *arena);
+
+// NULL once the arena is exhausted
+void *arena_alloc(arena_t *arena, size_t size);
+// Copy of s, NUL-terminated, not aligned
+char *arena_strdup(arena_t *arena, const char *s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ARENA_H
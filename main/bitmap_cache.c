@@ -0,0 +1,208 @@
+#include "bitmap_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t *bits;
+    uint16_t w;
+    uint16_t h;
+    int16_t prev;   // towards most recently used
+    int16_t next;   // towards least recently used
+} cache_entry_t;
+
+// Keys live in their own array so a lookup scans one contiguous block
+static uint64_t keys[BITMAP_CACHE_MAX_ENTRIES];
+static cache_entry_t entries[BITMAP_CACHE_MAX_ENTRIES];
+static int16_t lru_head = -1;
+static int16_t lru_tail = -1;
+static bitmap_cache_stats_t stats;
+
+// All bits live in one block of the budget's size, allocated at init, so
+// misses and evictions never touch the heap. by_offset lists the live
+// entries in address order to find the gaps between them.
+static uint8_t *pool;
+static int16_t by_offset[BITMAP_CACHE_MAX_ENTRIES];
+
+static size_t entry_size(const cache_entry_t *e)
+{
+    return (size_t)((e->w + 7) / 8) * e->h;
+}
+
+static void lru_unlink(int16_t i)
+{
+    cache_entry_t *e = &entries[i];
+    if (e->prev >= 0) entries[e->prev].next = e->next; else lru_head = e->next;
+    if (e->next >= 0) entries[e->next].prev = e->prev; else lru_tail = e->prev;
+    e->prev = e->next = -1;
+}
+
+static void lru_push_front(int16_t i)
+{
+    cache_entry_t *e = &entries[i];
+    e->prev = -1;
+    e->next = lru_head;
+    if (lru_head >= 0) entries[lru_head].prev = i;
+    lru_head = i;
+    if (lru_tail < 0) lru_tail = i;
+}
+
+static void entry_release(int16_t i)
+{
+    cache_entry_t *e = &entries[i];
+    lru_unlink(i);
+    stats.bytes_used -= entry_size(e);
+    int n = 0;
+    while (by_offset[n] != i) n++;
+    memmove(&by_offset[n], &by_offset[n + 1], (size_t)(stats.entries - n - 1) * sizeof(by_offset[0]));
+    stats.entries--;
+    e->bits = NULL;
+    keys[i] = 0;
+}
+
+// Smallest gap of at least size bytes; *pos is where its entry goes in by_offset
+static uint8_t *pool_fit(size_t size, int *pos)
+{
+    uint8_t *best = NULL;
+    size_t best_len = 0;
+    uint8_t *start = pool;
+    for (int n = 0; n <= stats.entries; n++) {
+        uint8_t *end = n < stats.entries ? entries[by_offset[n]].bits : pool + stats.budget;
+        size_t len = (size_t)(end - start);
+        if (len >= size && (!best || len < best_len)) {
+            best = start;
+            best_len = len;
+            *pos = n;
+        }
+        if (n < stats.entries) start = end + entry_size(&entries[by_offset[n]]);
+    }
+    return best;
+}
+
+// Slide entries down, lowest address first, until the gap opened behind
+// them fits size. The eviction loop leaves enough free bytes in total, so
+// at the latest the run after the last entry fits.
+static uint8_t *pool_compact(size_t size, int *pos)
+{
+    uint8_t *to = pool;
+    int n = 0;
+    for (; n < stats.entries; n++) {
+        cache_entry_t *e = &entries[by_offset[n]];
+        if ((size_t)(e->bits - to) >= size) break;
+        if (e->bits != to) memmove(to, e->bits, entry_size(e));
+        e->bits = to;
+        to += entry_size(e);
+    }
+    *pos = n;
+    stats.compactions++;
+    return to;
+}
+
+static int16_t find(uint64_t key, int w, int h)
+{
+    for (int16_t i = 0; i < BITMAP_CACHE_MAX_ENTRIES; i++) {
+        if (keys[i] == key && entries[i].bits && entries[i].w == w && entries[i].h == h) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void bitmap_cache_clear(void)
+{
+    while (lru_tail >= 0) {
+        entry_release(lru_tail);
+    }
+}
+
+void bitmap_cache_init(size_t budget)
+{
+    bitmap_cache_clear();
+    // Keep the pool across configs with the same budget
+    if (budget != stats.budget || !pool) {
+        free(pool);
+        pool = budget ? (uint8_t *)malloc(budget) : NULL;
+    }
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < BITMAP_CACHE_MAX_ENTRIES; i++) {
+        entries[i].prev = entries[i].next = -1;
+    }
+    stats.budget = pool ? budget : 0;
+}
+
+uint64_t bitmap_cache_hash(uint64_t seed, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t bitmap_cache_hash_str(uint64_t seed, const char *s)
+{
+    // Include the terminator so ("ab", "c") and ("a", "bc") hash differently
+    return bitmap_cache_hash(seed, s, strlen(s) + 1);
+}
+
+const uint8_t *bitmap_cache_lookup(uint64_t key, int w, int h)
+{
+    int16_t i = find(key, w, h);
+    if (i < 0) {
+        stats.misses++;
+        return NULL;
+    }
+    stats.hits++;
+    lru_unlink(i);
+    lru_push_front(i);
+    return entries[i].bits;
+}
+
+uint8_t *bitmap_cache_insert(uint64_t key, int w, int h)
+{
+    size_t size = (size_t)((w + 7) / 8) * (size_t)h;
+    if (size == 0 || size > stats.budget) {
+        return NULL;
+    }
+
+    int16_t i = find(key, w, h);
+    if (i >= 0) {
+        lru_unlink(i);
+        lru_push_front(i);
+        return entries[i].bits;
+    }
+
+    while (lru_tail >= 0 && (stats.bytes_used + size > stats.budget || stats.entries == BITMAP_CACHE_MAX_ENTRIES)) {
+        entry_release(lru_tail);
+        stats.evictions++;
+    }
+
+    // The eviction loop guarantees a free slot and enough free bytes, though
+    // maybe not in one piece
+    i = 0;
+    while (entries[i].bits) i++;
+
+    int pos;
+    uint8_t *bits = pool_fit(size, &pos);
+    if (!bits) {
+        bits = pool_compact(size, &pos);
+    }
+    memmove(&by_offset[pos + 1], &by_offset[pos], (size_t)(stats.entries - pos) * sizeof(by_offset[0]));
+    by_offset[pos] = i;
+
+    keys[i] = key;
+    entries[i].bits = bits;
+    entries[i].w = (uint16_t)w;
+    entries[i].h = (uint16_t)h;
+    lru_push_front(i);
+    stats.bytes_used += size;
+    stats.entries++;
+    stats.inserts++;
+    return bits;
+}
+
+void bitmap_cache_get_stats(bitmap_cache_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,57 @@
+#ifndef BITMAP_CACHE_H
+#define BITMAP_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Content-addressed LRU cache of packed 1bpp widget cells. Keys are hashes of
+// whatever determines the pixels (widget type, rendered data, cell size);
+// entries are evicted least-recently-used first to stay within the budget.
+// The budget is allocated once at init and entries are carved out of it.
+
+#ifndef BITMAP_CACHE_MAX_ENTRIES
+#define BITMAP_CACHE_MAX_ENTRIES 64
+#endif
+
+#define BITMAP_CACHE_HASH_SEED 0xcbf29ce484222325ULL
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t inserts;
+    uint32_t evictions;
+    uint32_t compactions;   // inserts that had to close gaps in the pool first
+    size_t bytes_used;
+    size_t budget;
+    int entries;
+} bitmap_cache_stats_t;
+
+// (Re)initialise with a memory budget in bytes, dropping all entries. The
+// cache stays empty if the budget cannot be allocated.
+void bitmap_cache_init(size_t budget);
+void bitmap_cache_clear(void);
+
+// FNV-1a, chainable: feed the previous result back in as seed
+uint64_t bitmap_cache_hash(uint64_t seed, const void *data, size_t len);
+uint64_t bitmap_cache_hash_str(uint64_t seed, const char *s);
+
+// Returns the packed bits ((w + 7) / 8 * h bytes) or NULL, counting a hit or a miss
+const uint8_t *bitmap_cache_lookup(uint64_t key, int w, int h);
+
+// Reserve storage for a packed bitmap under key, evicting older entries as
+// needed. The caller fills the returned buffer; NULL if it cannot be cached.
+// Returned bits stay valid only until the next insert, which may move them.
+uint8_t *bitmap_cache_insert(uint64_t key, int w, int h);
+
+void bitmap_cache_get_stats(bitmap_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BITMAP_CACHE_H
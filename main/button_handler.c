@@ -0,0 +1,146 @@
+#include "button_handler.h"
+#include "config_parser.h"
+#include "display_manager.hpp"
+#include "app_mqtt.h"
+#include "driver/gpio.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "BUTTONS";
+
+#define BUTTON_TASK_STACK 3072
+#define BUTTON_TASK_PRIORITY 6
+// A falling edge is a press if the pin still reads low this long after it,
+// and a held button is released once its pin has read high this long
+#define BUTTON_SETTLE_US (20 * 1000)
+// How often held buttons are polled for their release
+#define BUTTON_POLL_MS 10
+
+typedef struct {
+    int index;
+    int64_t pressed_us;
+} button_event_t;
+
+static QueueHandle_t button_queue;
+// A button acts once per press: it is held from the accepted falling edge
+// until it reads high again, and edges in between (bounce on press and on
+// release) are ignored
+static bool held[4];
+static int64_t high_since_us[4];
+
+static void IRAM_ATTR button_isr(void *arg)
+{
+    // Timestamp in the ISR so the flip latency includes the queueing
+    button_event_t event = { (int)(intptr_t)arg, esp_timer_get_time() };
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(button_queue, &event, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void button_run_action(const button_action_t *action, int64_t pressed_us)
+{
+    if (strcmp(action->type, "next_page") == 0) {
+        display_step_page(1, pressed_us);
+    } else if (strcmp(action->type, "prev_page") == 0) {
+        display_step_page(-1, pressed_us);
+    } else if (strcmp(action->type, "page") == 0) {
+        display_show_page(atoi(action->payload), pressed_us);
+    } else if (strcmp(action->type, "publish") == 0) {
+        mqtt_app_publish(action->topic, action->payload);
+    } else {
+        ESP_LOGW(TAG, "Unknown button action: %s", action->type);
+    }
+}
+
+// Re-arms held buttons whose pin has read high for the settle time
+static bool button_poll_release(const app_config_t *config)
+{
+    bool any_held = false;
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < config->num_buttons; i++) {
+        if (!held[i]) {
+            continue;
+        }
+        if (gpio_get_level(config->buttons[i].gpio) == 0) {
+            high_since_us[i] = 0;
+        } else if (high_since_us[i] == 0) {
+            high_since_us[i] = now;
+        } else if (now - high_since_us[i] >= BUTTON_SETTLE_US) {
+            held[i] = false;
+            continue;
+        }
+        any_held = true;
+    }
+    return any_held;
+}
+
+static void button_task(void *arg)
+{
+    button_event_t event;
+    bool any_held = false;
+    for (;;) {
+        TickType_t wait = any_held ? pdMS_TO_TICKS(BUTTON_POLL_MS) : portMAX_DELAY;
+        bool received = xQueueReceive(button_queue, &event, wait) == pdTRUE;
+        const app_config_t *config = get_config();
+        if (!config) {
+            continue;
+        }
+        any_held = button_poll_release(config);
+        if (!received || event.index >= config->num_buttons || held[event.index]) {
+            continue;
+        }
+
+        // Let the contacts settle; a pin that is high again was a glitch or
+        // the bounce of a release
+        int64_t wait_us = event.pressed_us + BUTTON_SETTLE_US - esp_timer_get_time();
+        if (wait_us > 0) {
+            vTaskDelay(pdMS_TO_TICKS(wait_us / 1000) + 1);
+        }
+        if (gpio_get_level(config->buttons[event.index].gpio) != 0) {
+            continue;
+        }
+        held[event.index] = true;
+        high_since_us[event.index] = 0;
+        any_held = true;
+        button_run_action(&config->buttons[event.index].action, event.pressed_us);
+    }
+}
+
+void button_handler_start(void)
+{
+    const app_config_t *config = get_config();
+    if (!config || config->num_buttons == 0 || button_queue) {
+        return;
+    }
+
+    button_queue = xQueueCreate(8, sizeof(button_event_t));
+    if (!button_queue) {
+        ESP_LOGE(TAG, "Failed to create button queue");
+        return;
+    }
+    gpio_install_isr_service(0);
+
+    for (int i = 0; i < config->num_buttons; i++) {
+        // Buttons pull the pin to ground
+        gpio_config_t io = {
+            .pin_bit_mask = 1ULL << config->buttons[i].gpio,
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = GPIO_PULLUP_ENABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_NEGEDGE,
+        };
+        if (gpio_config(&io) != ESP_OK ||
+            gpio_isr_handler_add(config->buttons[i].gpio, button_isr, (void *)(intptr_t)i) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to set up button on GPIO %d", config->buttons[i].gpio);
+            continue;
+        }
+        ESP_LOGI(TAG, "Button %d on GPIO %d: %s", i, config->buttons[i].gpio, config->buttons[i].action.type);
+    }
+
+    xTaskCreate(button_task, "buttons", BUTTON_TASK_STACK, NULL, BUTTON_TASK_PRIORITY, NULL);
+}
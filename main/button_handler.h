@@ -0,0 +1,16 @@
+#ifndef BUTTON_HANDLER_H
+#define BUTTON_HANDLER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Configure the GPIOs of the loaded config's buttons and start the task that
+// runs their actions. Call after display_init.
+void button_handler_start(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUTTON_HANDLER_H
@@ -0,0 +1,111 @@
+#include "canvas.h"
+#include <string.h>
+
+void canvas_init(canvas_t *canvas, uint8_t *buf, uint16_t width, uint16_t height, bool mirror_x)
+{
+    canvas->buf = buf;
+    canvas->width = width;
+    canvas->height = height;
+    canvas->stride = (uint16_t)((width + 7) / 8);
+    canvas->mirror_x = mirror_x;
+}
+
+bool canvas_clip_rect(const canvas_t *canvas, int *x, int *y, int *w, int *h)
+{
+    if (*x < 0) { *w += *x; *x = 0; }
+    if (*y < 0) { *h += *y; *y = 0; }
+    if (*x + *w > canvas->width) *w = canvas->width - *x;
+    if (*y + *h > canvas->height) *h = canvas->height - *y;
+    return *w > 0 && *h > 0;
+}
+
+static inline int phys_left(const canvas_t *canvas, int x, int w)
+{
+    return canvas->mirror_x ? canvas->stride * 8 - x - w : x;
+}
+
+void canvas_read_rect(const canvas_t *canvas, int x, int y, int w, int h, uint8_t *out)
+{
+    int px = phys_left(canvas, x, w);
+    int out_stride = (w + 7) / 8;
+    uint8_t tail = (uint8_t)(0xFF << ((8 - (w & 7)) & 7));
+
+    for (int row = 0; row < h; row++) {
+        const uint8_t *src = &canvas->buf[(size_t)(y + row) * canvas->stride];
+        uint8_t *dst = &out[(size_t)row * out_stride];
+        if ((px & 7) == 0) {
+            memcpy(dst, src + (px >> 3), (size_t)out_stride);
+        } else {
+            memset(dst, 0, (size_t)out_stride);
+            for (int i = 0; i < w; i++) {
+                int b = px + i;
+                if (src[b >> 3] & (0x80 >> (b & 7))) dst[i >> 3] |= (uint8_t)(0x80 >> (i & 7));
+            }
+        }
+        dst[out_stride - 1] &= tail;
+    }
+}
+
+void canvas_write_rect(const canvas_t *canvas, int x, int y, int w, int h, const uint8_t *in)
+{
+    int px = phys_left(canvas, x, w);
+    int in_stride = (w + 7) / 8;
+    int full = w >> 3;
+    uint8_t tail = (uint8_t)(0xFF << ((8 - (w & 7)) & 7));
+
+    for (int row = 0; row < h; row++) {
+        uint8_t *dst = &canvas->buf[(size_t)(y + row) * canvas->stride];
+        const uint8_t *src = &in[(size_t)row * in_stride];
+        if ((px & 7) == 0) {
+            uint8_t *d = dst + (px >> 3);
+            memcpy(d, src, (size_t)full);
+            if (w & 7) d[full] = (uint8_t)((d[full] & ~tail) | (src[full] & tail));
+        } else {
+            for (int i = 0; i < w; i++) {
+                int b = px + i;
+                uint8_t mask = (uint8_t)(0x80 >> (b & 7));
+                if (src[i >> 3] & (0x80 >> (i & 7))) dst[b >> 3] |= mask;
+                else dst[b >> 3] &= (uint8_t)~mask;
+            }
+        }
+    }
+}
+
+void canvas_copy_rect(const canvas_t *dst, const canvas_t *src, int x, int y, int w, int h)
+{
+    int px = phys_left(src, x, w);
+    int first = px >> 3;
+    int last = (px + w - 1) >> 3;
+    uint8_t head = (uint8_t)(0xFF >> (px & 7));
+    uint8_t tail = (uint8_t)(0xFF << (7 - ((px + w - 1) & 7)));
+
+    for (int row = y; row < y + h; row++) {
+        const uint8_t *s = &src->buf[(size_t)row * src->stride];
+        uint8_t *d = &dst->buf[(size_t)row * dst->stride];
+        if (first == last) {
+            uint8_t mask = head & tail;
+            d[first] = (uint8_t)((d[first] & ~mask) | (s[first] & mask));
+            continue;
+        }
+        d[first] = (uint8_t)((d[first] & ~head) | (s[first] & head));
+        memcpy(&d[first + 1], &s[first + 1], (size_t)(last - first - 1));
+        d[last] = (uint8_t)((d[last] & ~tail) | (s[last] & tail));
+    }
+}
+
+void canvas_vspan(const canvas_t *canvas, int x, int y0, int y1, bool black)
+{
+    if (y0 > y1) { int t = y0; y0 = y1; y1 = t; }
+    if (x < 0 || x >= canvas->width || y1 < 0 || y0 >= canvas->height) {
+        return;
+    }
+    if (y0 < 0) y0 = 0;
+    if (y1 >= canvas->height) y1 = canvas->height - 1;
+
+    int px = canvas_phys_x(canvas, x);
+    uint8_t *p = &canvas->buf[(size_t)y0 * canvas->stride + (px >> 3)];
+    uint8_t mask = (uint8_t)(0x80 >> (px & 7));
+    for (int y = y0; y <= y1; y++, p += canvas->stride) {
+        if (black) *p |= mask; else *p &= (uint8_t)~mask;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// View over a packed 1bpp buffer (MSB first, set bit = black), addressed in
+// logical panel coordinates. The panel framebuffer is stored horizontally
+// mirrored (see Image_Init), so mirror_x maps logical x to stride*8 - 1 - x.
+typedef struct {
+    uint8_t *buf;
+    uint16_t width;
+    uint16_t height;
+    uint16_t stride;    // bytes per row
+    bool mirror_x;
+} canvas_t;
+
+// Write position within a canvas row, advanced one logical pixel at a time
+typedef struct {
+    uint8_t *byte;
+    uint8_t mask;
+    bool reverse;
+} canvas_cursor_t;
+
+void canvas_init(canvas_t *canvas, uint8_t *buf, uint16_t width, uint16_t height, bool mirror_x);
+
+// Clip a rectangle to the canvas bounds, returns false if nothing is left
+bool canvas_clip_rect(const canvas_t *canvas, int *x, int *y, int *w, int *h);
+
+// Bytes needed to hold a w x h rectangle packed row by row
+static inline size_t canvas_rect_size(int w, int h)
+{
+    return (size_t)((w + 7) / 8) * (size_t)h;
+}
+
+// Copy a rectangle out of / into a canvas as packed rows of (w + 7) / 8 bytes.
+// The packed form keeps the canvas' physical bit order, so a rectangle read
+// and written back at any position of the same canvas round-trips exactly.
+// Byte-aligned rectangles are copied with memcpy. The rectangle must lie
+// within the canvas.
+void canvas_read_rect(const canvas_t *canvas, int x, int y, int w, int h, uint8_t *out);
+void canvas_write_rect(const canvas_t *canvas, int x, int y, int w, int h, const uint8_t *in);
+
+// Copy a rectangle between two canvases of the same geometry
+void canvas_copy_rect(const canvas_t *dst, const canvas_t *src, int x, int y, int w, int h);
+
+// Set or clear column x from row y0 to y1 inclusive, clipped to the canvas
+void canvas_vspan(const canvas_t *canvas, int x, int y0, int y1, bool black);
+
+static inline int canvas_phys_x(const canvas_t *canvas, int x)
+{
+    return canvas->mirror_x ? canvas->stride * 8 - 1 - x : x;
+}
+
+static inline void canvas_set_pixel(const canvas_t *canvas, int x, int y, bool black)
+{
+    int px = canvas_phys_x(canvas, x);
+    uint8_t *p = &canvas->buf[(size_t)y * canvas->stride + (px >> 3)];
+    uint8_t mask = (uint8_t)(0x80 >> (px & 7));
+    if (black) *p |= mask; else *p &= (uint8_t)~mask;
+}
+
+static inline canvas_cursor_t canvas_cursor_at(const canvas_t *canvas, int x, int y)
+{
+    int px = canvas_phys_x(canvas, x);
+    canvas_cursor_t c = {
+        .byte = &canvas->buf[(size_t)y * canvas->stride + (px >> 3)],
+        .mask = (uint8_t)(0x80 >> (px & 7)),
+        .reverse = canvas->mirror_x,
+    };
+    return c;
+}
+
+static inline void canvas_cursor_put(canvas_cursor_t *c, bool black)
+{
+    if (black) *c->byte |= c->mask; else *c->byte &= (uint8_t)~c->mask;
+    if (c->reverse) {
+        c->mask = (uint8_t)(c->mask << 1);
+        if (c->mask == 0) { c->mask = 0x01; c->byte--; }
+    } else {
+        c->mask >>= 1;
+        if (c->mask == 0) { c->mask = 0x80; c->byte++; }
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CANVAS_H
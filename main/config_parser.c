@@ -1,13 +1,21 @@
 #include "config_parser.h"
+#include "arena.h"
+#include "layout.h"
+#include "topic_router.h"
 #include "esp_log.h"
 #include "esp_spiffs.h"
 #include "cJSON.h"
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 static const char *TAG = "CONFIG_PARSER";
 static app_config_t app_config;
+// Widget array and the strings it points to, sized exactly at load
+static arena_t config_arena;
+static size_t config_strings_start;
+static uint32_t app_config_generation;
 
 static void parse_mqtt_config(cJSON *mqtt_json, mqtt_config_t *mqtt_config) {
     cJSON *server = cJSON_GetObjectItem(mqtt_json, "server");
@@ -24,41 +32,247 @@ static void parse_mqtt_config(cJSON *mqtt_json, mqtt_config_t *mqtt_config) {
 
     cJSON *client_id = cJSON_GetObjectItem(mqtt_json, "client_id");
     if (cJSON_IsString(client_id)) strncpy(mqtt_config->client_id, client_id->valuestring, sizeof(mqtt_config->client_id) - 1);
+
+    cJSON *persistent = cJSON_GetObjectItem(mqtt_json, "persistent_session");
+    if (cJSON_IsBool(persistent)) mqtt_config->persistent_session = cJSON_IsTrue(persistent);
+
+    cJSON *version = cJSON_GetObjectItem(mqtt_json, "version");
+    if (cJSON_IsNumber(version)) mqtt_config->version = version->valueint;
+
+    cJSON *expiry = cJSON_GetObjectItem(mqtt_json, "session_expiry_s");
+    if (cJSON_IsNumber(expiry) && expiry->valuedouble >= 0) mqtt_config->session_expiry_s = expiry->valueint;
+
+    cJSON *receive_max = cJSON_GetObjectItem(mqtt_json, "receive_maximum");
+    if (cJSON_IsNumber(receive_max) && receive_max->valueint >= 0 && receive_max->valueint <= UINT16_MAX) {
+        mqtt_config->receive_maximum = receive_max->valueint;
+    }
+
+    cJSON *alias_max = cJSON_GetObjectItem(mqtt_json, "topic_alias_maximum");
+    if (cJSON_IsNumber(alias_max) && alias_max->valueint >= 0 && alias_max->valueint <= UINT16_MAX) {
+        mqtt_config->topic_alias_maximum = alias_max->valueint;
+    }
+
+    cJSON *batch_topic = cJSON_GetObjectItem(mqtt_json, "batch_topic");
+    if (cJSON_IsString(batch_topic)) {
+        if (topic_router_filter_valid(batch_topic->valuestring)) {
+            strncpy(mqtt_config->batch_topic, batch_topic->valuestring, sizeof(mqtt_config->batch_topic) - 1);
+        } else {
+            ESP_LOGW(TAG, "Batch topic '%s' is not a valid MQTT topic filter, batches are disabled", batch_topic->valuestring);
+        }
+    }
 }
 
-static void parse_widgets_config(cJSON *widgets_json, app_config_t *config) {
-    config->num_widgets = cJSON_GetArraySize(widgets_json);
-    if (config->num_widgets > 10) config->num_widgets = 10;
+static const char *const widget_type_names[WIDGET_TYPE_COUNT] = {
+    "info_card",
+    "weather_card",
+    "list",
+    "sparkline",
+};
 
-    for (int i = 0; i < config->num_widgets; i++) {
-        cJSON *widget_json = cJSON_GetArrayItem(widgets_json, i);
-        widget_config_t *widget_config = &config->widgets[i];
+const char *widget_type_name(widget_type_t type)
+{
+    return type < WIDGET_TYPE_COUNT ? widget_type_names[type] : "unknown";
+}
+
+widget_type_t widget_type_from_name(const char *name)
+{
+    for (int t = 0; t < WIDGET_TYPE_COUNT; t++) {
+        if (strcmp(name, widget_type_names[t]) == 0) {
+            return (widget_type_t)t;
+        }
+    }
+    return WIDGET_TYPE_UNKNOWN;
+}
+
+static const char *json_string(const cJSON *object, const char *key)
+{
+    const cJSON *item = cJSON_GetObjectItem(object, key);
+    return cJSON_IsString(item) ? item->valuestring : "";
+}
+
+// Existing copy of s from the config's string pool, or a new one. Widgets
+// sharing a topic share its storage.
+static const char *config_intern(const char *s)
+{
+    const char *p = (const char *)config_arena.base + config_strings_start;
+    const char *end = (const char *)config_arena.base + config_arena.used;
+    while (p < end) {
+        if (strcmp(p, s) == 0) return p;
+        p += strlen(p) + 1;
+    }
+    const char *copy = arena_strdup(&config_arena, s);
+    return copy ? copy : "";
+}
+
+// "history": {"samples": 240, "resolution": 0.1, "downsample": "lttb"}
+static void parse_history_config(const cJSON *history_json, widget_config_t *widget_config) {
+    if (widget_config->kind == WIDGET_TYPE_SPARKLINE) widget_config->history_samples = 240;
+    widget_config->history_resolution = 0.1f;
+    if (widget_config->precision >= 0) widget_config->history_resolution = powf(10.0f, (float)-widget_config->precision);
+    if (!history_json) return;
+
+    cJSON *samples = cJSON_GetObjectItem(history_json, "samples");
+    if (cJSON_IsNumber(samples)) widget_config->history_samples = samples->valueint;
+    if (widget_config->history_samples < 0) widget_config->history_samples = 0;
+    if (widget_config->history_samples > UINT16_MAX) widget_config->history_samples = UINT16_MAX;
+
+    cJSON *resolution = cJSON_GetObjectItem(history_json, "resolution");
+    if (cJSON_IsNumber(resolution) && resolution->valuedouble > 0) widget_config->history_resolution = (float)resolution->valuedouble;
+
+    cJSON *downsample = cJSON_GetObjectItem(history_json, "downsample");
+    if (cJSON_IsString(downsample) && strcmp(downsample->valuestring, "lttb") == 0) widget_config->downsample = DOWNSAMPLE_LTTB;
+}
+
+// "format": one numeric conversion such as "%.1f", "%6.2f", "%g" or "%d",
+// normalised to one that takes a double. Text around it is refused, the
+// unit comes from "unit" or the payload.
+static bool parse_value_format(const char *spec, widget_config_t *widget_config) {
+    const char *p = spec;
+    if (*p++ != '%') return false;
+    long width = -1, decimals = -1;
+    char *end;
+    if (*p >= '0' && *p <= '9') {
+        width = strtol(p, &end, 10);
+        p = end;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p < '0' || *p > '9') return false;
+        decimals = strtol(p, &end, 10);
+        p = end;
+    }
+    char conversion = *p++;
+    if (*p != '\0' || width > 32 || decimals > 9) return false;
+    switch (conversion) {
+        case 'd':
+        case 'i':
+            if (decimals >= 0) return false;
+            conversion = 'f';
+            decimals = 0;
+            break;
+        case 'f':
+        case 'e':
+        case 'g':
+            break;
+        default:
+            return false;
+    }
+
+    char *out = widget_config->format;
+    size_t size = sizeof(widget_config->format);
+    int n = snprintf(out, size, "%%");
+    if (width >= 0) n += snprintf(out + n, size - n, "%ld", width);
+    if (decimals >= 0) n += snprintf(out + n, size - n, ".%ld", decimals);
+    snprintf(out + n, size - n, "%c", conversion);
+    // A fixed number of decimals also sets the history's resolution
+    if (conversion == 'f' && decimals >= 0) widget_config->precision = (int)decimals;
+    return true;
+}
+
+static void parse_widget_config(cJSON *widget_json, widget_config_t *widget_config, int page) {
+    widget_config->page = page;
+    widget_config->name = config_intern(json_string(widget_json, "name"));
+    const char *topic = json_string(widget_json, "topic");
+    if (topic[0] && !topic_router_filter_valid(topic)) {
+        // '+' and '#' must fill a whole level and '#' must come last
+        ESP_LOGW(TAG, "Widget %s has malformed topic filter '%s', it will not be subscribed", widget_config->name, topic);
+        topic = "";
+    }
+    widget_config->topic = config_intern(topic);
+    widget_config->qos = 1;
+    cJSON *qos = cJSON_GetObjectItem(widget_json, "qos");
+    if (cJSON_IsNumber(qos) && qos->valueint >= 0 && qos->valueint <= 2) widget_config->qos = qos->valueint;
+    widget_config->value_path = config_intern(json_string(widget_json, "value_path"));
+    widget_config->unit_path = config_intern(json_string(widget_json, "unit_path"));
+    widget_config->unit = config_intern(json_string(widget_json, "unit"));
+
+    const char *type = json_string(widget_json, "type");
+    widget_config->kind = widget_type_from_name(type);
+    if (widget_config->kind == WIDGET_TYPE_UNKNOWN) {
+        ESP_LOGW(TAG, "Widget %s has unknown type '%s', it will not be drawn", widget_config->name, type);
+    }
 
-        cJSON *name = cJSON_GetObjectItem(widget_json, "name");
-        if (cJSON_IsString(name)) strncpy(widget_config->name, name->valuestring, sizeof(widget_config->name) - 1);
+    cJSON *deadband = cJSON_GetObjectItem(widget_json, "deadband");
+    if (cJSON_IsNumber(deadband)) widget_config->deadband = (float)deadband->valuedouble;
 
-        cJSON *type = cJSON_GetObjectItem(widget_json, "type");
-        if (cJSON_IsString(type)) strncpy(widget_config->type, type->valuestring, sizeof(widget_config->type) - 1);
+    widget_config->precision = -1;
+    cJSON *precision = cJSON_GetObjectItem(widget_json, "precision");
+    if (cJSON_IsNumber(precision)) widget_config->precision = precision->valueint;
+
+    const char *format = json_string(widget_json, "format");
+    if (format[0] && !parse_value_format(format, widget_config)) {
+        ESP_LOGW(TAG, "Widget %s has unsupported format '%s', values are shown as received", widget_config->name, format);
+        widget_config->format[0] = '\0';
+    } else if (!format[0] && widget_config->precision >= 0 && widget_config->precision <= 9) {
+        snprintf(widget_config->format, sizeof(widget_config->format), "%%.%df", widget_config->precision);
+    }
 
-        cJSON *topic = cJSON_GetObjectItem(widget_json, "topic");
-        if (cJSON_IsString(topic)) strncpy(widget_config->topic, topic->valuestring, sizeof(widget_config->topic) - 1);
+    parse_history_config(cJSON_GetObjectItem(widget_json, "history"), widget_config);
 
-        cJSON *position = cJSON_GetObjectItem(widget_json, "position");
-        if (position) {
-            cJSON *x = cJSON_GetObjectItem(position, "x");
-            if (cJSON_IsNumber(x)) widget_config->position.x = x->valueint;
-            cJSON *y = cJSON_GetObjectItem(position, "y");
-            if (cJSON_IsNumber(y)) widget_config->position.y = y->valueint;
+    cJSON *position = cJSON_GetObjectItem(widget_json, "position");
+    if (position) {
+        cJSON *x = cJSON_GetObjectItem(position, "x");
+        if (cJSON_IsNumber(x)) widget_config->position.x = x->valueint;
+        cJSON *y = cJSON_GetObjectItem(position, "y");
+        if (cJSON_IsNumber(y)) widget_config->position.y = y->valueint;
+    }
+
+    cJSON *size = cJSON_GetObjectItem(widget_json, "size");
+    if (size) {
+        cJSON *width = cJSON_GetObjectItem(size, "width");
+        if (cJSON_IsNumber(width)) widget_config->size.width = width->valueint;
+        cJSON *height = cJSON_GetObjectItem(size, "height");
+        if (cJSON_IsNumber(height)) widget_config->size.height = height->valueint;
+    }
+}
+
+// Widget array of a page: "pages": [{"widgets": [...]}, ...], or the
+// top-level "widgets" array as the only page of a single-page config
+static cJSON *page_widgets(cJSON *root, int page) {
+    cJSON *pages_json = cJSON_GetObjectItem(root, "pages");
+    if (!cJSON_IsArray(pages_json)) return cJSON_GetObjectItem(root, "widgets");
+    return cJSON_GetObjectItem(cJSON_GetArrayItem(pages_json, page), "widgets");
+}
+
+static bool parse_widgets_config(cJSON *root, app_config_t *config) {
+    cJSON *pages_json = cJSON_GetObjectItem(root, "pages");
+    int num_pages = cJSON_IsArray(pages_json) ? cJSON_GetArraySize(pages_json) : 1;
+    if (num_pages < 1) num_pages = 1;
+
+    // Size the arena for the widget array plus every string, before interning
+    int count = 0;
+    size_t strings = 1;
+    for (int page = 0; page < num_pages; page++) {
+        cJSON *widgets_json = page_widgets(root, page);
+        for (int i = 0; i < cJSON_GetArraySize(widgets_json); i++) {
+            cJSON *widget_json = cJSON_GetArrayItem(widgets_json, i);
+            strings += strlen(json_string(widget_json, "name")) + 1;
+            strings += strlen(json_string(widget_json, "topic")) + 1;
+            strings += strlen(json_string(widget_json, "value_path")) + 1;
+            strings += strlen(json_string(widget_json, "unit_path")) + 1;
+            strings += strlen(json_string(widget_json, "unit")) + 1;
+            count++;
         }
+    }
+    size_t bytes = arena_align((size_t)count * sizeof(widget_config_t)) + strings;
+    if (!arena_init(&config_arena, bytes)) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for %d widgets", (unsigned)bytes, count);
+        return false;
+    }
+    config->widgets = (widget_config_t *)arena_alloc(&config_arena, (size_t)count * sizeof(widget_config_t));
+    config_strings_start = config_arena.used;
+    config->num_widgets = count;
+    config->num_pages = num_pages;
 
-        cJSON *size = cJSON_GetObjectItem(widget_json, "size");
-        if (size) {
-            cJSON *width = cJSON_GetObjectItem(size, "width");
-            if (cJSON_IsNumber(width)) widget_config->size.width = width->valueint;
-            cJSON *height = cJSON_GetObjectItem(size, "height");
-            if (cJSON_IsNumber(height)) widget_config->size.height = height->valueint;
+    int index = 0;
+    for (int page = 0; page < num_pages; page++) {
+        cJSON *widgets_json = page_widgets(root, page);
+        for (int i = 0; i < cJSON_GetArraySize(widgets_json); i++) {
+            parse_widget_config(cJSON_GetArrayItem(widgets_json, i), &config->widgets[index++], page);
         }
     }
+    ESP_LOGI(TAG, "%d widgets on %d pages use %u bytes of config arena", count, num_pages, (unsigned)config_arena.used);
+    return true;
 }
 
 static void parse_buttons_config(cJSON *buttons_json, app_config_t *config) {
@@ -84,6 +298,35 @@ static void parse_buttons_config(cJSON *buttons_json, app_config_t *config) {
     }
 }
 
+static void parse_display_config(cJSON *display_json, display_config_t *display_config) {
+    cJSON *cache_kb = cJSON_GetObjectItem(display_json, "cache_kb");
+    if (cJSON_IsNumber(cache_kb)) display_config->bitmap_cache_kb = cache_kb->valueint;
+
+    cJSON *quiet_ms = cJSON_GetObjectItem(display_json, "coalesce_quiet_ms");
+    if (cJSON_IsNumber(quiet_ms)) display_config->coalesce_quiet_ms = quiet_ms->valueint;
+
+    cJSON *max_ms = cJSON_GetObjectItem(display_json, "coalesce_max_ms");
+    if (cJSON_IsNumber(max_ms)) display_config->coalesce_max_ms = max_ms->valueint;
+
+    cJSON *startup_ms = cJSON_GetObjectItem(display_json, "startup_timeout_ms");
+    if (cJSON_IsNumber(startup_ms)) display_config->startup_timeout_ms = startup_ms->valueint;
+}
+
+// A message matching both the batch topic and a widget's topic would be
+// applied twice, once as a batch and once as that widget's payload
+static void check_batch_topic(app_config_t *config)
+{
+    for (int i = 0; i < config->num_widgets; i++) {
+        const char *topic = config->widgets[i].topic;
+        if (topic[0] && topic_router_filters_overlap(config->mqtt.batch_topic, topic)) {
+            ESP_LOGW(TAG, "Batch topic '%s' overlaps topic '%s' of widget %s, batches are disabled",
+                     config->mqtt.batch_topic, topic, config->widgets[i].name);
+            config->mqtt.batch_topic[0] = '\0';
+            return;
+        }
+    }
+}
+
 bool load_config(void) {
     esp_vfs_spiffs_conf_t conf = {
       .base_path = "/spiffs",
@@ -119,18 +362,37 @@ bool load_config(void) {
         return false;
     }
 
+    arena_free(&config_arena);
     memset(&app_config, 0, sizeof(app_config_t));
+    app_config.display.bitmap_cache_kb = 32;
+    app_config.display.coalesce_quiet_ms = 250;
+    app_config.display.coalesce_max_ms = 1000;
+    app_config.display.startup_timeout_ms = 5000;
+    app_config.mqtt.session_expiry_s = 24 * 3600;
+    app_config.mqtt.topic_alias_maximum = 16;
 
     cJSON *mqtt_json = cJSON_GetObjectItem(root, "mqtt");
     if (mqtt_json) parse_mqtt_config(mqtt_json, &app_config.mqtt);
 
-    cJSON *widgets_json = cJSON_GetObjectItem(root, "widgets");
-    if (widgets_json) parse_widgets_config(widgets_json, &app_config);
+    if (!parse_widgets_config(root, &app_config)) {
+        cJSON_Delete(root);
+        return false;
+    }
+
+    if (app_config.mqtt.batch_topic[0]) check_batch_topic(&app_config);
 
     cJSON *buttons_json = cJSON_GetObjectItem(root, "buttons");
     if (buttons_json) parse_buttons_config(buttons_json, &app_config);
 
+    cJSON *display_json = cJSON_GetObjectItem(root, "display");
+    if (display_json) parse_display_config(display_json, &app_config.display);
+
     cJSON_Delete(root);
+    layout_build(&app_config);
+    if (!topic_router_build(&app_config)) {
+        ESP_LOGE(TAG, "Failed to build topic routing index");
+    }
+    app_config_generation++;
     ESP_LOGI(TAG, "Configuration loaded successfully");
     return true;
 }
@@ -138,3 +400,7 @@ bool load_config(void) {
 const app_config_t* get_config(void) {
     return &app_config;
 }
+
+uint32_t config_generation(void) {
+    return app_config_generation;
+}
@@ -3,6 +3,7 @@
 
 #include "config_types.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -10,6 +11,11 @@ extern "C" {
 
 bool load_config(void);
 const app_config_t* get_config(void);
+// Bumped on every successful load_config(), lets caches derived from the config notice reloads
+uint32_t config_generation(void);
+// Config "type" string of a widget type and back, WIDGET_TYPE_UNKNOWN if unrecognised
+const char *widget_type_name(widget_type_t type);
+widget_type_t widget_type_from_name(const char *name);
 
 #ifdef __cplusplus
 }
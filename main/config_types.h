@@ -1,6 +1,7 @@
 #ifndef CONFIG_TYPES_H
 #define CONFIG_TYPES_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 // MQTT Configuration
@@ -9,7 +10,14 @@ typedef struct {
     int port;
     char username[64];
     char password[64];
-    char client_id[64];
+    char client_id[64];     // "" = "eink-" and the last MAC bytes
+    bool persistent_session; // broker keeps subscriptions and QoS 1+ messages while offline
+    int version;            // 5 for MQTT 5, anything else is 3.1.1
+    // MQTT 5 only
+    int session_expiry_s;   // how long a persistent session outlives the connection
+    int receive_maximum;    // QoS 1+ messages the broker may have in flight, 0 = one per widget
+    int topic_alias_maximum; // topic aliases the broker may assign, 0 = none
+    char batch_topic[128];  // one payload updating many widgets, keyed by widget name or index; "" = none
 } mqtt_config_t;
 
 // Widget Position and Size
@@ -23,16 +31,45 @@ typedef struct {
     int height;
 } widget_size_t;
 
-// Widget Configuration
+// Widget types, resolved from the config's "type" string once at load.
+// Indexes the display manager's per-type ops table.
+typedef enum {
+    WIDGET_TYPE_INFO_CARD,
+    WIDGET_TYPE_WEATHER_CARD,
+    WIDGET_TYPE_LIST,
+    WIDGET_TYPE_SPARKLINE,
+    WIDGET_TYPE_COUNT,
+    WIDGET_TYPE_UNKNOWN = WIDGET_TYPE_COUNT,
+} widget_type_t;
+
+// How a trend view reduces more samples than it has pixel columns
+typedef enum {
+    DOWNSAMPLE_MINMAX,  // min/max span per column, keeps every spike
+    DOWNSAMPLE_LTTB,    // largest-triangle-three-buckets, smoother line
+} downsample_t;
+
+// Widget Configuration. Strings are interned in the config arena and never NULL.
 typedef struct {
-    char name[64];
-    char type[32];
+    const char *name;
+    widget_type_t kind;
+    int page;           // dashboard page the widget is shown on
     position_t position;
     widget_size_t size;
-    char topic[128];
+    const char *topic;
+    int qos;                // subscription QoS; widgets sharing a topic get the highest
+    const char *value_path; // JSON path of the value in the payload, "" = the type's "value"
+    const char *unit_path;  // likewise for the unit
+    const char *unit;       // fixed unit shown instead of one from the payload, "" = none
+    char format[8];         // printf conversion numeric values are shown with, "" = as received
+    float deadband;     // ignore numeric changes smaller than this, 0 = any change
+    int precision;      // decimals numeric values are rounded to, -1 = as received
+    int history_samples;        // numeric values kept for trend views, 0 = none
+    float history_resolution;   // step the kept values are quantised to
+    downsample_t downsample;
 } widget_config_t;
 
-// Button Action
+// Button Action. type is "next_page", "prev_page", "page" (payload holds the
+// page number) or "publish" (payload is sent to topic).
 typedef struct {
     char type[32];
     char topic[128];
@@ -45,13 +82,23 @@ typedef struct {
     button_action_t action;
 } button_config_t;
 
+// Display Configuration
+typedef struct {
+    int bitmap_cache_kb;    // budget for cached widget bitmaps, 0 disables
+    int coalesce_quiet_ms;  // commit once no update arrived for this long
+    int coalesce_max_ms;    // but never later than this after the first one
+    int startup_timeout_ms; // longest the first frame waits for retained values, 0 = draw at once
+} display_config_t;
+
 // Main Configuration Struct
 typedef struct {
     mqtt_config_t mqtt;
-    widget_config_t widgets[10]; // Max 10 widgets
+    widget_config_t *widgets; // num_widgets entries, allocated from the config arena
     int num_widgets;
+    int num_pages;
     button_config_t buttons[4]; // Max 4 buttons
     int num_buttons;
+    display_config_t display;
 } app_config_t;
 
 #endif // CONFIG_TYPES_H
@@ -1,20 +1,54 @@
 #include "display_manager.hpp"
 #include "esp_log.h"
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <vector>
-#include <cJSON.h>
 
 // ESP-IDF Waveshare driver wrapper
 #include "epd.h"
+#include "epd_driver.h"
 
 // Config and data
 #include "config_parser.h"
 #include "widget_data.h"
+#include "arena.h"
+#include "history.h"
+#include "histlog.h"
+#include "page_cache.h"
+#include "snapshot.h"
+#include "bitmap_cache.h"
+#include "layout.h"
+#include "update_mailbox.h"
+#include "json_extract.h"
+#include "topic_router.h"
+#include "alloc_probe.h"
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 static const char *TAG = "DISPLAY";
 
+// Keep panel work off the core running Wi-Fi and esp-mqtt
+#if CONFIG_FREERTOS_UNICORE
+#define DISPLAY_TASK_CORE 0
+#else
+#define DISPLAY_TASK_CORE 1
+#endif
+#define DISPLAY_TASK_STACK 6144
+#define DISPLAY_TASK_PRIORITY 5
+// Quiet time before neighbouring pages are rendered into the page cache
+#define DISPLAY_PRERENDER_IDLE_MS 500
+// Save the frame on the panel to flash at most this often
+#define DISPLAY_SNAPSHOT_INTERVAL_S 300
+// Quiet time after the last SUBACK that ends the burst of retained messages
+#define DISPLAY_STARTUP_SETTLE_MS 300
+// Widgets one batch topic payload may update
+#define DISPLAY_BATCH_MAX_MEMBERS 32
+
 // Minimal wrapper over our driver to mimic used API
 static inline void display_fillScreen(uint8_t color) { epd_fill_screen(color); }
 static inline void display_fillRect(int x,int y,int w,int h,uint8_t color){ epd_fill_rect(x,y,w,h,color);} 
@@ -25,178 +59,1586 @@ static inline void display_setTextSize(int s){ epd_set_text_size(s);}
 static inline void display_print(const char* s){ epd_print(s);} 
 static inline void display_update(){ epd_update(); }
 
-// Widget data store
-static widget_data_t widget_data_store[10]; // Max 10 widgets
+// Per-widget runtime state, one arena sized from the loaded config
+typedef struct {
+    widget_data_t *data;    // only as large as the widget type's own data struct
+    const json_program_t *program;  // extracts the widget's payloads, NULL if its paths are invalid
+    int64_t arrived_us;     // oldest update folded into the frame being built
+    bool dirty;             // data changed since the cell was last pushed to the panel
+    bool committed;         // part of the frame just refreshed, for the latency histogram
+    history_t history;      // capacity 0 unless the widget keeps a history
+    uint32_t log_id;        // identifies the widget's records in the history log
+} widget_state_t;
+
+static arena_t state_arena;
+static widget_state_t *widget_state;
+// Parse target for incoming payloads, compared with the stored data before committing
+static widget_data_t scratch_data;
+// Payload fields of each type, shared by the widgets that set no paths of their own
+static json_program_t type_programs[WIDGET_TYPE_COUNT];
+// Decoded history of the trend view being drawn, sized for the largest history
+static history_point_t *history_points;
+// History clock: continues from the newest logged sample so persisted and
+// new samples stay ordered across reboots (there is no wall clock)
+static uint32_t clock_base_s;
+// The history log is due for compaction; done once updates pause
+static bool compaction_pending;
+// Whether the panel currently shows a full widget frame that cells can be patched into
+static bool frame_on_panel;
+
+// Page on the panel, and a flip requested by the buttons but not done yet
+static int current_page;
+static int requested_page = -1;
+static int64_t requested_pressed_us;
+static portMUX_TYPE page_lock = portMUX_INITIALIZER_UNLOCKED;
+// Button press behind the flip in progress, 0 if none
+static int64_t flip_pressed_us;
+// A frame did not compress enough to be cached; retry after the next change
+static bool prerender_blocked;
+
+// Widget data blocks in the order they are saved to the snapshot
+static snapshot_part_t *snapshot_parts;
+// The panel changed since the last snapshot
+static bool snapshot_pending;
+static int64_t snapshot_saved_us;
+// The frame came from the boot snapshot and has not been re-rendered since
+static bool snapshot_restored;
+// Boot found a snapshot for this config
+static bool restored_at_boot;
+
+// Startup barrier: the first frame waits for the subscriptions' retained values
+static volatile bool startup_holding;
+static volatile bool startup_subscribed;
+static int64_t startup_deadline_us;
+
+static TaskHandle_t render_task;
+static volatile bool full_render_requested;
+
+static display_stats_t stats;
+
+static void display_render_frame(const app_config_t *config);
+static void display_render_task(void *arg);
+static bool display_build_state(const app_config_t *config);
+static bool display_init_mailbox(const app_config_t *config);
+static void display_restore_history(const app_config_t *config);
+static void display_restore_snapshot(const app_config_t *config);
+static void display_flip_started(void);
 
 extern "C" void display_init(void)
 {
     ESP_LOGI(TAG, "Initializing display");
     epd_begin();
+
+    const app_config_t *config = get_config();
+    if (!display_build_state(config) || !display_init_mailbox(config)) {
+        return;
+    }
+    display_restore_history(config);
+    display_restore_snapshot(config);
+    // Only worth holding the first frame when subscriptions will deliver data
+    if (config->display.startup_timeout_ms > 0 && topic_router_filter_count() > 0) {
+        startup_deadline_us = esp_timer_get_time() + (int64_t)config->display.startup_timeout_ms * 1000;
+        startup_holding = true;
+    }
+    if (xTaskCreatePinnedToCore(display_render_task, "display", DISPLAY_TASK_STACK, NULL,
+                                DISPLAY_TASK_PRIORITY, &render_task, DISPLAY_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start render task, rendering synchronously");
+        render_task = NULL;
+        startup_holding = false;
+        return;
+    }
+    update_mailbox_set_consumer(render_task);
 }
 
-static void display_render_info_card(const widget_config_t *widget, const info_card_data_t *data)
+extern "C" void display_get_canvas(canvas_t *canvas)
 {
-    ESP_LOGI(TAG, "Rendering info card: %s, value: %s %s", widget->name, data->value, data->unit);
+    canvas_init(canvas, epd_get_framebuffer(), EPD_WIDTH, EPD_HEIGHT, epd_framebuffer_mirrored());
+}
 
-    int x, y, w, h;
-    //display_get_grid_rect(widget->position.x, widget->position.y, widget->size.width, widget->size.height, &x, &y, &w, &h);
-    // For now, let's just use hardcoded values
-    x = 10; y = 10; w = 100; h = 50;
+// Canvas over whatever buffer drawing currently goes to
+static void display_target_canvas(canvas_t *canvas)
+{
+    canvas_init(canvas, epd_get_target(), EPD_WIDTH, EPD_HEIGHT, epd_framebuffer_mirrored());
+}
+
+static bool display_on_page(const widget_config_t *widget)
+{
+    return widget->page == current_page;
+}
 
+// Card border of widget i, false if the layout has no cell for it
+static bool display_widget_rect(int index, int *x, int *y, int *w, int *h)
+{
+    const layout_t *layout = layout_get();
+    if (index >= layout->count) {
+        return false;
+    }
+    layout_rect_t card = layout_card_rect(layout->cells[index]);
+    *x = card.x;
+    *y = card.y;
+    *w = card.w;
+    *h = card.h;
+    return true;
+}
+
+// Per-type widget behaviour, indexed by widget_config_t.kind. A new widget
+// type adds a widget_type_t value and one entry in widget_ops_table.
+typedef struct {
+    size_t data_size;       // bytes of widget_data_t the type actually uses
+    size_t max_payload;     // mailbox slot size, larger payloads are dropped
+    uint8_t border_color;
+    // Payload fields extracted into the type's data; a widget's own paths replace
+    // the ones named "value" and "unit"
+    const json_field_t *fields;
+    int num_fields;
+    // Given the fields extracted into next (a copy of current) and the mask
+    // of those that differ, true if the shown content changed
+    bool (*changed)(const widget_config_t *widget, const widget_data_t *current, widget_data_t *next, uint32_t mask);
+    // Extent of the drawn content relative to the card's top left corner
+    void (*measure)(const widget_data_t *data, int *w, int *h);
+    void (*render)(const widget_config_t *widget, int index, const widget_data_t *data);
+    // Fold everything the render depends on into a bitmap cache key
+    uint64_t (*hash)(uint64_t key, const widget_data_t *data);
+    // Numeric value recorded into the widget's history, NULL if the type has none
+    bool (*value)(const widget_data_t *data, float *out);
+    bool draws_history;
+} widget_ops_t;
+
+static const widget_ops_t *display_widget_ops(const widget_config_t *widget);
+
+// Static chrome: border, title and the separator under it. Only changes with the config.
+static void display_render_chrome(const widget_config_t *widget, int index)
+{
+    int x, y, w, h;
+    if (!display_widget_rect(index, &x, &y, &w, &h)) {
+        return;
+    }
 
-    display_fillRect(x, y, w, h, EPD_WHITE);
-    display_drawRect(x, y, w, h, EPD_BLACK);
+    const widget_ops_t *ops = display_widget_ops(widget);
+    uint8_t border = ops ? ops->border_color : EPD_BLACK;
+    display_drawRect(x, y, w, h, border);
 
-    display_setCursor(x + 5, y + 5);
+    display_setCursor(x + LAYOUT_PADDING, y + LAYOUT_PADDING);
     display_setTextColor(EPD_BLACK);
     display_setTextSize(2);
     display_print(widget->name);
 
-    display_setCursor(x + 5, y + 25);
+    display_fillRect(x, y + 20, w, 1, border);
+}
+
+// Chrome layer of the current page, rendered once per config generation and
+// page and copied in at the start of each frame
+static uint8_t *chrome_layer;
+static bool chrome_valid;
+static int chrome_page = -1;
+// Config generation the chrome layer and bitmap cache were built for
+static uint32_t frame_generation;
+static bool frame_state_valid;
+
+static bool display_build_chrome(const app_config_t *config)
+{
+    if (!chrome_layer) {
+        chrome_layer = (uint8_t *)malloc(EPD_ARRAY);
+        if (!chrome_layer) {
+            ESP_LOGW(TAG, "No memory for chrome layer, drawing chrome per frame");
+            return false;
+        }
+    }
+
+    epd_set_target(chrome_layer);
+    display_fillScreen(EPD_WHITE);
+    for (int i = 0; i < config->num_widgets; i++) {
+        if (display_on_page(&config->widgets[i])) display_render_chrome(&config->widgets[i], i);
+    }
+    epd_set_target(NULL);
+    chrome_page = current_page;
+
+    ESP_LOGI(TAG, "Chrome layer rebuilt for page %d", current_page);
+    return true;
+}
+
+static bool display_config_current(void)
+{
+    return frame_state_valid && frame_generation == config_generation();
+}
+
+// Set up the per-config render state: chrome, bitmap and page caches
+static void display_adopt_config(const app_config_t *config)
+{
+    if (current_page >= config->num_pages) current_page = 0;
+    chrome_valid = display_build_chrome(config);
+    bitmap_cache_init((size_t)config->display.bitmap_cache_kb * 1024);
+    page_cache_clear();
+    frame_generation = config_generation();
+    frame_state_valid = true;
+}
+
+static void display_begin_frame(const app_config_t *config)
+{
+    if (!display_config_current()) {
+        display_adopt_config(config);
+    } else if (chrome_page != current_page) {
+        chrome_valid = display_build_chrome(config);
+    }
+
+    if (chrome_valid) {
+        epd_load_layer(chrome_layer);
+        return;
+    }
+    display_fillScreen(EPD_WHITE);
+    for (int i = 0; i < config->num_widgets; i++) {
+        if (display_on_page(&config->widgets[i])) display_render_chrome(&config->widgets[i], i);
+    }
+}
+
+// Font8 glyph size, what the value lines are drawn with
+#define DISPLAY_VALUE_CHAR_W 5
+#define DISPLAY_VALUE_CHAR_H 8
+#define DISPLAY_VALUE_TOP    25
+#define DISPLAY_LIST_PITCH   10
+
+// Parses s as a plain number, rejecting trailing text such as units
+static bool display_parse_number(const char *s, double *out)
+{
+    char *end;
+    double v = strtod(s, &end);
+    if (end == s) {
+        return false;
+    }
+    while (*end == ' ') end++;
+    if (*end != '\0') {
+        return false;
+    }
+    *out = v;
+    return true;
+}
+
+// Apply the widget's format to an incoming value in place and decide
+// whether it differs enough from the displayed one to be shown
+static bool display_value_changed(const widget_config_t *widget, const char *current, char *incoming, size_t size)
+{
+    double value;
+    bool numeric = display_parse_number(incoming, &value);
+    if (numeric && widget->format[0]) {
+        snprintf(incoming, size, widget->format, value);
+    }
+    if (strcmp(incoming, current) == 0) {
+        return false;
+    }
+
+    double shown;
+    if (numeric && widget->deadband > 0 && display_parse_number(current, &shown) &&
+        fabs(value - shown) < widget->deadband) {
+        return false;
+    }
+    return true;
+}
+
+// Width in pixels of "a b" drawn at text size 1
+static int display_value_width(const char *a, const char *b)
+{
+    return (int)(strlen(a) + 1 + strlen(b)) * DISPLAY_VALUE_CHAR_W;
+}
+
+// info_card: a single "value unit" line
+
+static const json_field_t info_card_fields[] = {
+    { "value", JSON_FIELD_STRING, offsetof(info_card_data_t, value), sizeof(info_card_data_t::value), 0, 0 },
+    { "unit", JSON_FIELD_STRING, offsetof(info_card_data_t, unit), sizeof(info_card_data_t::unit), 0, 0 },
+};
+
+// The value (field 0) goes through rounding and the deadband, the rest
+// changes on any difference
+static bool info_card_changed(const widget_config_t *widget, const widget_data_t *current, widget_data_t *next, uint32_t mask)
+{
+    info_card_data_t *d = &next->info_card;
+    return display_value_changed(widget, current->info_card.value, d->value, sizeof(d->value)) || (mask & ~1u) != 0;
+}
+
+static void info_card_measure(const widget_data_t *data, int *w, int *h)
+{
+    *w = LAYOUT_PADDING + display_value_width(data->info_card.value, data->info_card.unit);
+    *h = DISPLAY_VALUE_TOP + DISPLAY_VALUE_CHAR_H;
+}
+
+static void info_card_render(const widget_config_t *widget, int index, const widget_data_t *widget_data)
+{
+    const info_card_data_t *data = &widget_data->info_card;
+    ESP_LOGI(TAG, "Rendering info card: %s, value: %s %s", widget->name, data->value, data->unit);
+
+    int x, y, w, h;
+    if (!display_widget_rect(index, &x, &y, &w, &h)) {
+        return;
+    }
+
+    display_setCursor(x + LAYOUT_PADDING, y + DISPLAY_VALUE_TOP);
+    display_setTextColor(EPD_BLACK);
     display_setTextSize(1);
     char value_str[128];
     snprintf(value_str, 128, "%s %s", data->value, data->unit);
     display_print(value_str);
 }
 
-static void display_render_weather_card(const widget_config_t *widget, const weather_card_data_t *data)
+static uint64_t info_card_hash(uint64_t key, const widget_data_t *data)
 {
-    ESP_LOGI(TAG, "Rendering weather card: %s, value: %s %s", widget->name, data->value, data->unit);
-    int x = 120, y = 10, w = 100, h = 50;
+    key = bitmap_cache_hash_str(key, data->info_card.value);
+    return bitmap_cache_hash_str(key, data->info_card.unit);
+}
+
+static bool info_card_value(const widget_data_t *data, float *out)
+{
+    double v;
+    if (!display_parse_number(data->info_card.value, &v)) {
+        return false;
+    }
+    *out = (float)v;
+    return true;
+}
 
-    display_fillRect(x, y, w, h, EPD_WHITE);
-    display_drawRect(x, y, w, h, EPD_RED);
+// weather_card: an icon in red followed by "value unit"
 
-    display_setCursor(x + 5, y + 5);
-    display_setTextColor(EPD_BLACK);
-    display_setTextSize(2);
-    display_print(widget->name);
+static const json_field_t weather_card_fields[] = {
+    { "value", JSON_FIELD_STRING, offsetof(weather_card_data_t, value), sizeof(weather_card_data_t::value), 0, 0 },
+    { "unit", JSON_FIELD_STRING, offsetof(weather_card_data_t, unit), sizeof(weather_card_data_t::unit), 0, 0 },
+    { "icon", JSON_FIELD_STRING, offsetof(weather_card_data_t, icon), sizeof(weather_card_data_t::icon), 0, 0 },
+};
 
-    display_setCursor(x + 5, y + 25);
+static bool weather_card_changed(const widget_config_t *widget, const widget_data_t *current, widget_data_t *next, uint32_t mask)
+{
+    weather_card_data_t *d = &next->weather_card;
+    return display_value_changed(widget, current->weather_card.value, d->value, sizeof(d->value)) || (mask & ~1u) != 0;
+}
+
+static void weather_card_measure(const widget_data_t *data, int *w, int *h)
+{
+    int icon_w = LAYOUT_PADDING + (int)strlen(data->weather_card.icon) * DISPLAY_VALUE_CHAR_W;
+    int value_w = LAYOUT_PADDING + 15 + display_value_width(data->weather_card.value, data->weather_card.unit);
+    *w = icon_w > value_w ? icon_w : value_w;
+    *h = DISPLAY_VALUE_TOP + DISPLAY_VALUE_CHAR_H;
+}
+
+static void weather_card_render(const widget_config_t *widget, int index, const widget_data_t *widget_data)
+{
+    const weather_card_data_t *data = &widget_data->weather_card;
+    ESP_LOGI(TAG, "Rendering weather card: %s, value: %s %s", widget->name, data->value, data->unit);
+
+    int x, y, w, h;
+    if (!display_widget_rect(index, &x, &y, &w, &h)) {
+        return;
+    }
+
+    display_setCursor(x + LAYOUT_PADDING, y + DISPLAY_VALUE_TOP);
     display_setTextColor(EPD_RED);
     display_setTextSize(1);
     display_print(data->icon);
 
-    display_setCursor(x + 20, y + 25);
+    display_setCursor(x + LAYOUT_PADDING + 15, y + DISPLAY_VALUE_TOP);
     display_setTextColor(EPD_BLACK);
     char value_str[128];
     snprintf(value_str, 128, "%s %s", data->value, data->unit);
     display_print(value_str);
 }
 
-static void display_render_list_widget(const widget_config_t *widget, const list_widget_data_t *data)
+static uint64_t weather_card_hash(uint64_t key, const widget_data_t *data)
+{
+    key = bitmap_cache_hash_str(key, data->weather_card.value);
+    key = bitmap_cache_hash_str(key, data->weather_card.unit);
+    return bitmap_cache_hash_str(key, data->weather_card.icon);
+}
+
+static bool weather_card_value(const widget_data_t *data, float *out)
+{
+    double v;
+    if (!display_parse_number(data->weather_card.value, &v)) {
+        return false;
+    }
+    *out = (float)v;
+    return true;
+}
+
+// list: one "label: value" line per item
+
+#define LIST_CAPACITY (int)(sizeof(list_widget_data_t::items) / sizeof(list_item_t))
+
+static const json_field_t list_fields[] = {
+    { "items[]", JSON_FIELD_COUNT, offsetof(list_widget_data_t, num_items), 0, 0, LIST_CAPACITY },
+    { "items[].label", JSON_FIELD_STRING, offsetof(list_widget_data_t, items) + offsetof(list_item_t, label),
+      sizeof(list_item_t::label), sizeof(list_item_t), LIST_CAPACITY },
+    { "items[].value", JSON_FIELD_STRING, offsetof(list_widget_data_t, items) + offsetof(list_item_t, value),
+      sizeof(list_item_t::value), sizeof(list_item_t), LIST_CAPACITY },
+};
+
+static bool list_changed(const widget_config_t *widget, const widget_data_t *current, widget_data_t *next, uint32_t mask)
+{
+    return mask != 0;
+}
+
+static void list_measure(const widget_data_t *data, int *w, int *h)
+{
+    const list_widget_data_t *list = &data->list_widget;
+    *w = 0;
+    for (int i = 0; i < list->num_items; i++) {
+        // "label: value" is one character wider than "label value"
+        int item_w = LAYOUT_PADDING + display_value_width(list->items[i].label, list->items[i].value) + DISPLAY_VALUE_CHAR_W;
+        if (item_w > *w) *w = item_w;
+    }
+    *h = list->num_items > 0 ? DISPLAY_VALUE_TOP + (list->num_items - 1) * DISPLAY_LIST_PITCH + DISPLAY_VALUE_CHAR_H : 0;
+}
+
+static void list_render(const widget_config_t *widget, int index, const widget_data_t *widget_data)
 {
+    const list_widget_data_t *data = &widget_data->list_widget;
     ESP_LOGI(TAG, "Rendering list widget: %s", widget->name);
-    int x = 10, y = 70, w = 210, h = 100;
 
-    display_fillRect(x, y, w, h, EPD_WHITE);
-    display_drawRect(x, y, w, h, EPD_BLACK);
+    int x, y, w, h;
+    if (!display_widget_rect(index, &x, &y, &w, &h)) {
+        return;
+    }
 
-    display_setCursor(x + 5, y + 5);
     display_setTextColor(EPD_BLACK);
-    display_setTextSize(2);
-    display_print(widget->name);
-
     display_setTextSize(1);
     for (int i = 0; i < data->num_items; i++) {
         char item_str[128];
         snprintf(item_str, 128, "%s: %s", data->items[i].label, data->items[i].value);
-        display_setCursor(x + 5, y + 25 + (i * 10));
+        display_setCursor(x + LAYOUT_PADDING, y + DISPLAY_VALUE_TOP + (i * DISPLAY_LIST_PITCH));
         display_print(item_str);
     }
 }
 
+static uint64_t list_hash(uint64_t key, const widget_data_t *data)
+{
+    const list_widget_data_t *list = &data->list_widget;
+    key = bitmap_cache_hash(key, &list->num_items, sizeof(list->num_items));
+    for (int i = 0; i < list->num_items; i++) {
+        key = bitmap_cache_hash_str(key, list->items[i].label);
+        key = bitmap_cache_hash_str(key, list->items[i].value);
+    }
+    return key;
+}
+
+// sparkline: the current "value unit" over a trend of the widget's history.
+// Shares info_card's data, the samples live in the widget's history.
 
-extern "C" void display_render_widgets(void)
+#define SPARKLINE_CHART_TOP (DISPLAY_VALUE_TOP + DISPLAY_VALUE_CHAR_H + 4)
+
+static const history_t *display_widget_history(int index)
 {
-    const app_config_t *config = get_config();
-    if (!config) {
-        ESP_LOGE(TAG, "Cannot render widgets, config not loaded");
+    return &widget_state[index].history;
+}
+
+// Straight line drawn as one vertical span per column
+static void display_span_line(const canvas_t *canvas, int x0, int y0, int x1, int y1)
+{
+    if (x1 < x0) {
+        int t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+    }
+    int dx = x1 - x0;
+    if (dx == 0) {
+        canvas_vspan(canvas, x0, y0, y1, true);
         return;
     }
+    for (int x = x0; x <= x1; x++) {
+        // Rows crossed between this column's centre and the next one's
+        int ya = y0 + (y1 - y0) * (x - x0) / dx;
+        int xb = x < x1 ? x + 1 : x1;
+        int yb = y0 + (y1 - y0) * (xb - x0) / dx;
+        canvas_vspan(canvas, x, ya, yb == ya ? ya : (yb > ya ? yb - 1 : yb + 1), true);
+    }
+}
 
-    ESP_LOGI(TAG, "Rendering %d widgets", config->num_widgets);
+// Chart geometry shared by both reducers
+typedef struct {
+    int x, y, w, h;
+    uint32_t t0, t_span;
+    float v0, v_span;
+} sparkline_area_t;
 
-    display_fillScreen(EPD_WHITE);
+static int sparkline_col(const sparkline_area_t *a, uint32_t t)
+{
+    return a->x + (int)((uint64_t)(t - a->t0) * (uint64_t)(a->w - 1) / a->t_span);
+}
 
-    for (int i = 0; i < config->num_widgets; i++) {
+static int sparkline_row(const sparkline_area_t *a, float v)
+{
+    return a->y + a->h - 1 - (int)lroundf((v - a->v0) * (float)(a->h - 1) / a->v_span);
+}
+
+// One span per column covering every sample that falls into it, joined to
+// the previous column so the trace stays connected
+static void sparkline_draw_minmax(const canvas_t *canvas, const sparkline_area_t *a, const history_point_t *points, int n)
+{
+    int col = -1, lo = 0, hi = 0, last = 0;
+    for (int i = 0; i < n; i++) {
+        int c = sparkline_col(a, points[i].t);
+        int row = sparkline_row(a, points[i].v);
+        if (c != col) {
+            if (col >= 0) {
+                canvas_vspan(canvas, col, lo, hi, true);
+                if (c - col > 1) {
+                    display_span_line(canvas, col, last, c, row);
+                }
+            }
+            lo = hi = (col >= 0 && c - col == 1) ? last : row;
+            col = c;
+        }
+        if (row < lo) lo = row;
+        if (row > hi) hi = row;
+        last = row;
+    }
+    if (col >= 0) {
+        canvas_vspan(canvas, col, lo, hi, true);
+    }
+}
+
+static void sparkline_draw_lttb(const canvas_t *canvas, const sparkline_area_t *a, history_point_t *points, int n)
+{
+    if (n > a->w) {
+        n = history_lttb(points, n, points, a->w);
+    }
+    for (int i = 1; i < n; i++) {
+        display_span_line(canvas, sparkline_col(a, points[i - 1].t), sparkline_row(a, points[i - 1].v),
+                          sparkline_col(a, points[i].t), sparkline_row(a, points[i].v));
+    }
+    if (n == 1) {
+        canvas_vspan(canvas, sparkline_col(a, points[0].t), sparkline_row(a, points[0].v), sparkline_row(a, points[0].v), true);
+    }
+}
+
+static void sparkline_render(const widget_config_t *widget, int index, const widget_data_t *widget_data)
+{
+    info_card_render(widget, index, widget_data);
+
+    int x, y, w, h;
+    const history_t *history = display_widget_history(index);
+    if (!display_widget_rect(index, &x, &y, &w, &h) || !history_points || history->count == 0) {
+        return;
+    }
+
+    sparkline_area_t area;
+    area.x = x + LAYOUT_PADDING;
+    area.y = y + SPARKLINE_CHART_TOP;
+    area.w = w - 2 * LAYOUT_PADDING;
+    area.h = h - SPARKLINE_CHART_TOP - LAYOUT_PADDING;
+    if (area.w < 2 || area.h < 2) {
+        return;
+    }
+
+    int n = history_decode(history, history_points);
+    float vmin = history_points[0].v, vmax = vmin;
+    for (int i = 1; i < n; i++) {
+        if (history_points[i].v < vmin) vmin = history_points[i].v;
+        if (history_points[i].v > vmax) vmax = history_points[i].v;
+    }
+    if (vmax - vmin < history->resolution) {
+        // Flat series: centre it instead of dividing by zero
+        vmin -= history->resolution;
+        vmax += history->resolution;
+    }
+    area.t0 = history_points[0].t;
+    area.t_span = history_points[n - 1].t > area.t0 ? history_points[n - 1].t - area.t0 : 1;
+    area.v0 = vmin;
+    area.v_span = vmax - vmin;
+
+    canvas_t canvas;
+    display_target_canvas(&canvas);
+    if (widget->downsample == DOWNSAMPLE_LTTB) {
+        sparkline_draw_lttb(&canvas, &area, history_points, n);
+    } else {
+        sparkline_draw_minmax(&canvas, &area, history_points, n);
+    }
+}
+
+// In widget_type_t order
+static const widget_ops_t widget_ops_table[WIDGET_TYPE_COUNT] = {
+#define FIELDS(table) table, (int)(sizeof(table) / sizeof(table[0]))
+    { sizeof(info_card_data_t), UPDATE_MAILBOX_SLOT_SIZE, EPD_BLACK, FIELDS(info_card_fields), info_card_changed, info_card_measure, info_card_render, info_card_hash, info_card_value, false },
+    { sizeof(weather_card_data_t), UPDATE_MAILBOX_SLOT_SIZE, EPD_RED, FIELDS(weather_card_fields), weather_card_changed, weather_card_measure, weather_card_render, weather_card_hash, weather_card_value, false },
+    { sizeof(list_widget_data_t), UPDATE_MAILBOX_MAX_SLOT_SIZE, EPD_BLACK, FIELDS(list_fields), list_changed, list_measure, list_render, list_hash, NULL, false },
+    { sizeof(info_card_data_t), UPDATE_MAILBOX_SLOT_SIZE, EPD_BLACK, FIELDS(info_card_fields), info_card_changed, info_card_measure, sparkline_render, info_card_hash, info_card_value, true },
+#undef FIELDS
+};
+
+static const widget_ops_t *display_widget_ops(const widget_config_t *widget)
+{
+    return widget->kind < WIDGET_TYPE_COUNT ? &widget_ops_table[widget->kind] : NULL;
+}
+
+// Samples kept for widget i, 0 if its type records no numeric value
+static int display_history_capacity(const widget_config_t *widget)
+{
+    const widget_ops_t *ops = display_widget_ops(widget);
+    return ops && ops->value ? widget->history_samples : 0;
+}
+
+// Whether the widget reads its payloads differently from its type's default
+static bool display_custom_fields(const widget_config_t *widget)
+{
+    return widget->value_path[0] || widget->unit_path[0] || widget->unit[0];
+}
+
+// Compile the type's payload fields, with the widget's own paths (if any) in
+// place of the type's "value" and "unit". A fixed unit is written into data
+// instead of being extracted.
+static bool display_compile_fields(const widget_config_t *widget, const widget_ops_t *ops,
+                                   json_program_t *program, widget_data_t *data)
+{
+    json_program_init(program);
+    for (int i = 0; i < ops->num_fields; i++) {
+        json_field_t field = ops->fields[i];
+        if (widget && strcmp(field.path, "value") == 0 && widget->value_path[0]) {
+            // Device payloads mostly send numbers, not strings
+            field.path = widget->value_path;
+            field.kind = JSON_FIELD_SCALAR;
+        } else if (widget && strcmp(field.path, "unit") == 0 && widget->unit[0]) {
+            snprintf((char *)data + field.offset, field.size, "%s", widget->unit);
+            continue;
+        } else if (widget && strcmp(field.path, "unit") == 0 && widget->unit_path[0]) {
+            field.path = widget->unit_path;
+        }
+        if (!json_program_add(program, &field)) {
+            ESP_LOGW(TAG, "Widget %s: invalid path '%s', its updates are ignored", widget ? widget->name : "", field.path);
+            return false;
+        }
+    }
+    return true;
+}
+
+// The state block was sized from the same config, so running out means the
+// sizing above and the allocations below disagree
+static bool display_state_exhausted(void)
+{
+    ESP_LOGE(TAG, "Widget state arena exhausted after %u of %u bytes",
+             (unsigned)state_arena.used, (unsigned)state_arena.size);
+    arena_free(&state_arena);
+    widget_state = NULL;
+    history_points = NULL;
+    snapshot_parts = NULL;
+    return false;
+}
+
+// Allocate the state of every configured widget from one block: the state
+// array, each widget's data sized for its type and its history samples,
+// then the decode buffer trend views draw from
+static bool display_build_state(const app_config_t *config)
+{
+    int n = config->num_widgets;
+    int max_history = 0;
+    size_t bytes = arena_align((size_t)n * sizeof(widget_state_t));
+    for (int i = 0; i < n; i++) {
+        const widget_ops_t *ops = display_widget_ops(&config->widgets[i]);
+        int capacity = display_history_capacity(&config->widgets[i]);
+        if (ops) bytes += arena_align(ops->data_size);
+        if (ops && display_custom_fields(&config->widgets[i])) bytes += arena_align(sizeof(json_program_t));
+        bytes += arena_align(history_storage_size(capacity));
+        if (capacity > max_history) max_history = capacity;
+    }
+    bytes += arena_align((size_t)max_history * sizeof(history_point_t));
+    bytes += arena_align((size_t)n * sizeof(snapshot_part_t));
+
+    arena_free(&state_arena);
+    widget_state = NULL;
+    history_points = NULL;
+    snapshot_parts = NULL;
+    if (!arena_init(&state_arena, bytes)) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes of widget state", (unsigned)bytes);
+        return false;
+    }
+    if (n == 0) {
+        return true;
+    }
+    for (int t = 0; t < WIDGET_TYPE_COUNT; t++) {
+        display_compile_fields(NULL, &widget_ops_table[t], &type_programs[t], NULL);
+    }
+    widget_state = (widget_state_t *)arena_alloc(&state_arena, (size_t)n * sizeof(widget_state_t));
+    if (!widget_state) return display_state_exhausted();
+    for (int i = 0; i < n; i++) {
         const widget_config_t *widget = &config->widgets[i];
-        if (strcmp(widget->type, "info_card") == 0) {
-            display_render_info_card(widget, &widget_data_store[i].info_card);
-        } else if (strcmp(widget->type, "weather_card") == 0) {
-            display_render_weather_card(widget, &widget_data_store[i].weather_card);
-        } else if (strcmp(widget->type, "list") == 0) {
-            display_render_list_widget(widget, &widget_data_store[i].list_widget);
+        const widget_ops_t *ops = display_widget_ops(widget);
+        if (ops) {
+            widget_state[i].data = (widget_data_t *)arena_alloc(&state_arena, ops->data_size);
+            if (!widget_state[i].data) return display_state_exhausted();
         }
+        if (ops && display_custom_fields(widget)) {
+            json_program_t *program = (json_program_t *)arena_alloc(&state_arena, sizeof(json_program_t));
+            if (!program) return display_state_exhausted();
+            if (display_compile_fields(widget, ops, program, widget_state[i].data)) widget_state[i].program = program;
+        } else if (ops) {
+            widget_state[i].program = &type_programs[widget->kind];
+        }
+        int capacity = display_history_capacity(widget);
+        history_sample_t *samples = (history_sample_t *)arena_alloc(&state_arena, history_storage_size(capacity));
+        if (!samples) return display_state_exhausted();
+        history_init(&widget_state[i].history, samples, capacity, widget->history_resolution);
+        uint64_t id = bitmap_cache_hash_str(BITMAP_CACHE_HASH_SEED, widget->name);
+        widget_state[i].log_id = (uint32_t)(id ^ (id >> 32));
+    }
+    if (max_history > 0) {
+        history_points = (history_point_t *)arena_alloc(&state_arena, (size_t)max_history * sizeof(history_point_t));
+        if (!history_points) return display_state_exhausted();
     }
+    snapshot_parts = (snapshot_part_t *)arena_alloc(&state_arena, (size_t)n * sizeof(snapshot_part_t));
+    if (!snapshot_parts) return display_state_exhausted();
+    for (int i = 0; i < n; i++) {
+        const widget_ops_t *ops = display_widget_ops(&config->widgets[i]);
+        snapshot_parts[i].data = widget_state[i].data;
+        snapshot_parts[i].len = ops ? ops->data_size : 0;
+    }
+    ESP_LOGI(TAG, "Widget state for %d widgets: %u bytes", n, (unsigned)bytes);
+    return true;
+}
 
-    display_update();
-    ESP_LOGI(TAG, "Widgets rendered");
+// One mailbox slot per widget, sized for its type's payloads, and one of
+// the largest size after them for the batch topic
+static bool display_init_mailbox(const app_config_t *config)
+{
+    if (config->num_widgets == 0) {
+        return update_mailbox_init(0, NULL);
+    }
+    bool batch = config->mqtt.batch_topic[0] != '\0';
+    int slots = config->num_widgets + (batch ? 1 : 0);
+    size_t *sizes = (size_t *)malloc((size_t)slots * sizeof(size_t));
+    if (!sizes) {
+        return false;
+    }
+    for (int i = 0; i < config->num_widgets; i++) {
+        const widget_ops_t *ops = display_widget_ops(&config->widgets[i]);
+        sizes[i] = ops ? ops->max_payload : 0;
+    }
+    if (batch) {
+        sizes[config->num_widgets] = UPDATE_MAILBOX_MAX_SLOT_SIZE;
+    }
+    bool ok = update_mailbox_init(slots, sizes);
+    free(sizes);
+    return ok;
 }
 
-extern "C" void display_update_widget_by_topic(const char *topic, const char *data)
+static uint32_t display_now_s(void)
 {
-    const app_config_t *config = get_config();
-    if (!config) {
+    return clock_base_s + (uint32_t)(esp_timer_get_time() / 1000000);
+}
+
+static void display_replay_record(const histlog_record_t *record, void *arg)
+{
+    const app_config_t *config = (const app_config_t *)arg;
+    for (int i = 0; i < config->num_widgets; i++) {
+        history_t *history = &widget_state[i].history;
+        // Older than what the ring holds: a copy from a compaction run cut short
+        if (widget_state[i].log_id == record->id && history->capacity > 0 &&
+            (history->count == 0 || record->t >= history->last_ts)) {
+            history_push(history, record->t, record->value);
+        }
+    }
+}
+
+// Rewrite the log as just what the rings hold, before the log wraps onto
+// the samples they were last restored from
+static void display_compact_history(const app_config_t *config)
+{
+    if (!compaction_pending) {
+        return;
+    }
+    compaction_pending = false;
+    if (!history_points || !histlog_compact_begin()) {
         return;
     }
+    for (int i = 0; i < config->num_widgets; i++) {
+        int n = history_decode(&widget_state[i].history, history_points);
+        for (int k = 0; k < n; k++) {
+            histlog_compact_add(widget_state[i].log_id, history_points[k].t, history_points[k].v);
+        }
+    }
+    histlog_compact_end();
+}
 
-    // Find widget index by topic
-    int widget_index = -1;
+// Mount the history log and refill the widgets' rings from its tail
+static void display_restore_history(const app_config_t *config)
+{
+    int want = 0;
     for (int i = 0; i < config->num_widgets; i++) {
-        if (strcmp(config->widgets[i].topic, topic) == 0) {
-            widget_index = i;
-            break;
+        want += widget_state[i].history.capacity;
+    }
+    histlog_flash_t flash;
+    if (want == 0 || !histlog_flash_partition(&flash, "histlog") || !histlog_mount(&flash)) {
+        return;
+    }
+
+    // Rings holding more than one compaction run can carry would compact
+    // over and over; shrink them all by the same factor
+    int limit = histlog_compact_limit();
+    if (want > limit) {
+        ESP_LOGW(TAG, "History rings hold %d samples, more than the log compacts well (%d); shrinking them", want, limit);
+        for (int i = 0; i < config->num_widgets; i++) {
+            history_t *history = &widget_state[i].history;
+            int capacity = (int)((int64_t)history->capacity * limit / want);
+            history_init(history, history->samples, capacity, history->resolution);
+        }
+        want = limit;
+    }
+
+    clock_base_s = histlog_last_timestamp() + 1;
+    int replayed = histlog_replay(want, display_replay_record, (void *)config);
+    ESP_LOGI(TAG, "Restored %d history samples from flash", replayed);
+}
+
+// Identifies what a snapshot's frame and data belong to: every widget's
+// identity, type, page and cell
+static uint32_t display_snapshot_key(const app_config_t *config)
+{
+    const layout_t *layout = layout_get();
+    uint64_t key = bitmap_cache_hash(BITMAP_CACHE_HASH_SEED, &config->num_widgets, sizeof(config->num_widgets));
+    for (int i = 0; i < config->num_widgets; i++) {
+        const widget_config_t *widget = &config->widgets[i];
+        key = bitmap_cache_hash_str(key, widget->name);
+        key = bitmap_cache_hash(key, &widget->kind, sizeof(widget->kind));
+        key = bitmap_cache_hash(key, &widget->page, sizeof(widget->page));
+        key = bitmap_cache_hash_str(key, widget->unit);
+        key = bitmap_cache_hash_str(key, widget->format);
+        if (i < layout->count) key = bitmap_cache_hash(key, &layout->cells[i], sizeof(layout->cells[i]));
+    }
+    return (uint32_t)(key ^ (key >> 32));
+}
+
+// Mount the snapshot partition and, if its newest snapshot belongs to this
+// config, take its frame and data as what the panel shows: the next updates
+// can go straight to partial refreshes
+static void display_restore_snapshot(const app_config_t *config)
+{
+    histlog_flash_t flash;
+    if (!histlog_flash_partition(&flash, "snapshot") || !snapshot_mount(&flash)) {
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    uint32_t page;
+    if (!snapshot_load(display_snapshot_key(config), &page, epd_get_framebuffer(), EPD_ARRAY,
+                       snapshot_parts, config->num_widgets) ||
+        (int)page >= config->num_pages) {
+        return;
+    }
+    current_page = (int)page;
+    display_adopt_config(config);
+    epd_adopt_framebuffer();
+    frame_on_panel = true;
+    snapshot_restored = true;
+    restored_at_boot = true;
+    snapshot_saved_us = start;
+    stats.restore_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+    ESP_LOGI(TAG, "Restored page %d from snapshot in %u ms", current_page, (unsigned)stats.restore_ms);
+}
+
+// Save the frame on the panel and the widget data once
+// DISPLAY_SNAPSHOT_INTERVAL_S passed since the last save
+static void display_save_snapshot(const app_config_t *config)
+{
+    if (!snapshot_pending || !frame_on_panel || !display_config_current()) {
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (snapshot_saved_us != 0 && now - snapshot_saved_us < (int64_t)DISPLAY_SNAPSHOT_INTERVAL_S * 1000000) {
+        return;
+    }
+    snapshot_pending = false;
+    snapshot_saved_us = now;
+    snapshot_save(display_snapshot_key(config), (uint32_t)current_page, epd_get_framebuffer(), EPD_ARRAY,
+                  snapshot_parts, config->num_widgets);
+}
+
+// How long the render task may sleep before a pending snapshot is due
+static TickType_t display_snapshot_wait(void)
+{
+    if (!snapshot_pending) {
+        return portMAX_DELAY;
+    }
+    int64_t due_us = snapshot_saved_us + (int64_t)DISPLAY_SNAPSHOT_INTERVAL_S * 1000000 - esp_timer_get_time();
+    TickType_t ticks = pdMS_TO_TICKS(due_us > 0 ? due_us / 1000 : 0);
+    return ticks > 0 ? ticks : 1;
+}
+
+static bool display_state_ready(const app_config_t *config)
+{
+    return config->num_widgets == 0 || widget_state != NULL;
+}
+
+// Layout cell of widget i, clipped to the panel
+static bool display_widget_cell(const canvas_t *canvas, int index, int *x, int *y, int *w, int *h)
+{
+    const layout_t *layout = layout_get();
+    if (index >= layout->count) {
+        return false;
+    }
+    const layout_rect_t *cell = &layout->cells[index];
+    *x = cell->x;
+    *y = cell->y;
+    *w = cell->w;
+    *h = cell->h;
+    return canvas_clip_rect(canvas, x, y, w, h);
+}
+
+// Cache key over everything that ends up in the cell's pixels
+static uint64_t display_widget_key(const widget_config_t *widget, int index, const widget_ops_t *ops, const widget_data_t *data, int w, int h)
+{
+    uint64_t key = bitmap_cache_hash(BITMAP_CACHE_HASH_SEED, &widget->kind, sizeof(widget->kind));
+    key = bitmap_cache_hash_str(key, widget->name);
+    key = bitmap_cache_hash(key, &w, sizeof(w));
+    key = bitmap_cache_hash(key, &h, sizeof(h));
+    if (ops->draws_history) {
+        const history_t *history = display_widget_history(index);
+        key = bitmap_cache_hash(key, &history->revision, sizeof(history->revision));
+    }
+    return ops->hash(key, data);
+}
+
+// Render one widget into the frame, blitting from the bitmap cache when its
+// cell has been rendered with the same content before
+static void display_render_widget(const canvas_t *canvas, const widget_config_t *widget, int index, const widget_data_t *data)
+{
+    const widget_ops_t *ops = display_widget_ops(widget);
+    int x, y, w, h;
+    if (!ops || !display_widget_cell(canvas, index, &x, &y, &w, &h)) {
+        return;
+    }
+
+    uint64_t key = display_widget_key(widget, index, ops, data, w, h);
+    const uint8_t *cached = bitmap_cache_lookup(key, w, h);
+    if (cached) {
+        canvas_write_rect(canvas, x, y, w, h, cached);
+        return;
+    }
+
+    // Content past the card is neither cached nor covered by partial refreshes
+    int content_w, content_h;
+    ops->measure(data, &content_w, &content_h);
+    layout_rect_t card = layout_card_rect(layout_get()->cells[index]);
+    if (content_w > card.w || content_h > card.h) {
+        ESP_LOGW(TAG, "Widget %s content (%dx%d) overflows its card (%dx%d)", widget->name, content_w, content_h, card.w, card.h);
+    }
+    ops->render(widget, index, data);
+
+    uint8_t *slot = bitmap_cache_insert(key, w, h);
+    if (slot) {
+        canvas_read_rect(canvas, x, y, w, h, slot);
+    }
+}
+
+// Reset a cell to its chrome before the widget is drawn into it again
+static void display_restore_cell(const canvas_t *canvas, const app_config_t *config, int index, int x, int y, int w, int h)
+{
+    if (chrome_valid) {
+        canvas_t chrome;
+        canvas_init(&chrome, chrome_layer, canvas->width, canvas->height, canvas->mirror_x);
+        canvas_copy_rect(canvas, &chrome, x, y, w, h);
+        return;
+    }
+    display_fillRect(x, y, w - 1, h, EPD_WHITE);
+    display_render_chrome(&config->widgets[index], index);
+}
+
+// Re-render only the dirty widgets and refresh the bounding box of their
+// cells with the partial waveform. Falls back to a full frame when nothing
+// usable is on the panel yet or the config changed underneath.
+static bool display_render_dirty(const app_config_t *config)
+{
+    if (!frame_on_panel || !display_config_current() || chrome_page != current_page) {
+        display_render_frame(config);
+        return true;
+    }
+
+    canvas_t canvas;
+    display_get_canvas(&canvas);
+
+    int x0 = EPD_WIDTH, y0 = EPD_HEIGHT, x1 = 0, y1 = 0;
+    int rendered = 0;
+    for (int i = 0; i < config->num_widgets; i++) {
+        if (!widget_state[i].dirty) {
+            continue;
+        }
+        widget_state[i].dirty = false;
+
+        int x, y, w, h;
+        if (!display_widget_cell(&canvas, i, &x, &y, &w, &h)) {
+            continue;
         }
+        display_restore_cell(&canvas, config, i, x, y, w, h);
+        display_render_widget(&canvas, &config->widgets[i], i, widget_state[i].data);
+
+        if (x < x0) x0 = x;
+        if (y < y0) y0 = y;
+        if (x + w > x1) x1 = x + w;
+        if (y + h > y1) y1 = y + h;
+        rendered++;
     }
 
-    if (widget_index == -1) {
-        ESP_LOGW(TAG, "No widget found for topic: %s", topic);
+    if (rendered == 0) {
+        return false;
+    }
+    page_cache_invalidate(current_page);
+    snapshot_pending = true;
+    if ((x1 - x0) * (y1 - y0) > EPD_WIDTH * EPD_HEIGHT / 2) {
+        display_update();
+    } else {
+        epd_update_region(x0, y0, x1 - x0, y1 - y0);
+    }
+    ESP_LOGI(TAG, "Refreshed %d widget(s) in %dx%d at (%d,%d)", rendered, x1 - x0, y1 - y0, x0, y0);
+    return true;
+}
+
+static void display_render_frame(const app_config_t *config)
+{
+    ESP_LOGI(TAG, "Rendering page %d", current_page);
+
+    display_begin_frame(config);
+
+    canvas_t canvas;
+    display_get_canvas(&canvas);
+    for (int i = 0; i < config->num_widgets; i++) {
+        if (!display_on_page(&config->widgets[i])) continue;
+        display_render_widget(&canvas, &config->widgets[i], i, widget_state[i].data);
+        widget_state[i].dirty = false;
+    }
+
+    display_flip_started();
+    display_update();
+    frame_on_panel = true;
+    snapshot_pending = true;
+    snapshot_restored = false;
+    if (config->num_pages > 1) {
+        page_cache_store(current_page, epd_get_framebuffer(), EPD_ARRAY);
+    }
+
+    bitmap_cache_stats_t stats;
+    bitmap_cache_get_stats(&stats);
+    ESP_LOGI(TAG, "Widgets rendered (cache: %u hits, %u misses, %u evictions, %u bytes)",
+             (unsigned)stats.hits, (unsigned)stats.misses, (unsigned)stats.evictions, (unsigned)stats.bytes_used);
+}
+
+// Render a whole page into buf, leaving the framebuffer and panel alone
+static void display_compose_page(const app_config_t *config, int page, uint8_t *buf)
+{
+    epd_set_target(buf);
+    display_fillScreen(EPD_WHITE);
+    for (int i = 0; i < config->num_widgets; i++) {
+        if (config->widgets[i].page == page) display_render_chrome(&config->widgets[i], i);
+    }
+    canvas_t canvas;
+    display_target_canvas(&canvas);
+    for (int i = 0; i < config->num_widgets; i++) {
+        if (config->widgets[i].page == page) display_render_widget(&canvas, &config->widgets[i], i, widget_state[i].data);
+    }
+    epd_set_target(NULL);
+}
+
+// Page whose cache entry should be refreshed while idle: the one on the
+// panel, then the next and previous ones. -1 when all are current.
+static int display_prerender_candidate(const app_config_t *config)
+{
+    int n = config->num_pages;
+    if (n <= 1 || prerender_blocked || !frame_on_panel || !chrome_valid || !display_config_current()) {
+        return -1;
+    }
+    int next = (current_page + 1) % n;
+    int prev = (current_page + n - 1) % n;
+    if (!page_cache_valid(current_page)) return current_page;
+    if (!page_cache_valid(next)) return next;
+    if (!page_cache_valid(prev)) return prev;
+    return -1;
+}
+
+static void display_prerender(const app_config_t *config, int page)
+{
+    if (page == current_page) {
+        prerender_blocked = !page_cache_store(page, epd_get_framebuffer(), EPD_ARRAY);
         return;
     }
+    // The chrome layer doubles as the off-screen buffer and is rebuilt after
+    int64_t start = esp_timer_get_time();
+    display_compose_page(config, page, chrome_layer);
+    prerender_blocked = !page_cache_store(page, chrome_layer, EPD_ARRAY);
+    chrome_valid = display_build_chrome(config);
+    ESP_LOGI(TAG, "Pre-rendered page %d in %d ms", page, (int)((esp_timer_get_time() - start) / 1000));
+}
+
+// Index of the first bucket whose upper bound holds value
+static int display_hist_bucket(uint32_t value, const uint32_t *bounds)
+{
+    int i = 0;
+    while (i < DISPLAY_HIST_BUCKETS - 1 && value > bounds[i]) i++;
+    return i;
+}
 
+static const uint32_t updates_bounds[DISPLAY_HIST_BUCKETS - 1] = {1, 2, 4, 8, 16, 32, 64};
+static const uint32_t latency_bounds[DISPLAY_HIST_BUCKETS - 1] = {100, 250, 500, 1000, 2000, 5000, 10000};
+static const uint32_t flip_bounds[DISPLAY_HIST_BUCKETS - 1] = {25, 50, 100, 250, 500, 1000, 2000};
+
+// The panel upload of a page flip starts now: record the time since the press
+static void display_flip_started(void)
+{
+    if (flip_pressed_us == 0) {
+        return;
+    }
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - flip_pressed_us) / 1000);
+    stats.flip_ms[display_hist_bucket(ms, flip_bounds)]++;
+    stats.last_flip_ms = ms;
+    flip_pressed_us = 0;
+}
+
+// Show page: decode it from the page cache when it is there, render it otherwise
+static void display_flip_page(const app_config_t *config, int page, int64_t pressed_us)
+{
+    if (page == current_page && frame_on_panel) {
+        return;
+    }
+    current_page = page;
+    flip_pressed_us = pressed_us;
+    prerender_blocked = false;
+    stats.page_flips++;
+
+    if (display_config_current() && page_cache_load(page, epd_get_framebuffer(), EPD_ARRAY)) {
+        stats.page_cache_hits++;
+        display_flip_started();
+        display_update();
+        frame_on_panel = true;
+        snapshot_pending = true;
+        // Off the critical path: partial updates on this page need its chrome
+        chrome_valid = display_build_chrome(config);
+        return;
+    }
+    display_render_frame(config);
+}
+
+static bool display_take_page_request(int *page, int64_t *pressed_us)
+{
+    taskENTER_CRITICAL(&page_lock);
+    bool pending = requested_page >= 0;
+    *page = requested_page;
+    *pressed_us = requested_pressed_us;
+    requested_page = -1;
+    taskEXIT_CRITICAL(&page_lock);
+    return pending;
+}
+
+// A payload changed widget i: mark its cell dirty on the current page,
+// otherwise drop the stale cached frame of the widget's page
+static void display_mark_changed(const app_config_t *config, int index)
+{
+    prerender_blocked = false;
+    if (display_on_page(&config->widgets[index])) {
+        widget_state[index].dirty = true;
+    } else {
+        page_cache_invalidate(config->widgets[index].page);
+    }
+}
+
+// Bit of the extract mask for the widget's "value" field, wherever its
+// program reads it from; 0 if the program has none
+static uint32_t display_value_bit(const widget_ops_t *ops, const json_program_t *program)
+{
+    for (int i = 0; i < ops->num_fields; i++) {
+        if (strcmp(ops->fields[i].path, "value") != 0) {
+            continue;
+        }
+        for (int f = 0; f < program->num_fields; f++) {
+            if (program->fields[f].offset == ops->fields[i].offset) return 1u << f;
+        }
+    }
+    return 0;
+}
+
+// Parse a payload into the widget's data store entry. Runs on the render
+// task. Returns true only if what the widget displays actually changed.
+static bool display_apply_payload(const app_config_t *config, int widget_index, const char *data, size_t len,
+                                  payload_encoding_t encoding)
+{
     const widget_config_t *widget = &config->widgets[widget_index];
+    const widget_ops_t *ops = display_widget_ops(widget);
+    const json_program_t *program = widget_state[widget_index].program;
+    if (!ops || !program) {
+        return false;
+    }
+
+    // Extract into a copy first so the new state can be compared with the shown one
+    widget_data_t *stored = widget_state[widget_index].data;
+    memcpy(&scratch_data, stored, ops->data_size);
+    uint32_t mask;
+    if (!payload_extract(encoding, data, len, program, &scratch_data, &mask)) {
+        ESP_LOGE(TAG, "Failed to parse widget data for %s", widget->name);
+        return false;
+    }
+    bool changed = ops->changed(widget, stored, &scratch_data, mask);
+
+    // History records every new value, including ones too small to redraw
+    // for; a payload that left the value alone (only a unit, say) adds nothing
+    float value;
+    history_t *history = &widget_state[widget_index].history;
+    if (history->capacity > 0 && ops->value && (mask & display_value_bit(ops, program)) &&
+        ops->value(&scratch_data, &value)) {
+        uint32_t now = display_now_s();
+        history_push(history, now, value);
+        histlog_append(widget_state[widget_index].log_id, now, value);
+        if (histlog_compaction_due()) compaction_pending = true;
+    }
+
+    if (!changed) {
+        stats.updates_suppressed++;
+        ESP_LOGD(TAG, "Widget %s unchanged, update suppressed", widget->name);
+        return false;
+    }
+    memcpy(stored, &scratch_data, ops->data_size);
+    stats.updates_applied++;
     ESP_LOGI(TAG, "Updating widget: %s", widget->name);
+    return true;
+}
+
+// Block until an update arrives, then keep collecting until the stream has
+// been quiet for coalesce_quiet_ms or coalesce_max_ms passed since the first.
+// Returns false if nothing arrived within idle.
+static bool display_wait_for_updates(const display_config_t *cfg, TickType_t idle)
+{
+    if (ulTaskNotifyTake(pdTRUE, idle) == 0) {
+        return false;
+    }
+
+    // Page flips skip the window, a button press should act at once
+    int64_t first_us = esp_timer_get_time();
+    while (!full_render_requested && requested_page < 0) {
+        int64_t remaining_ms = cfg->coalesce_max_ms - (esp_timer_get_time() - first_us) / 1000;
+        if (remaining_ms <= 0) {
+            break;
+        }
+        int64_t wait_ms = cfg->coalesce_quiet_ms < remaining_ms ? cfg->coalesce_quiet_ms : remaining_ms;
+        if (wait_ms <= 0 || ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms)) == 0) {
+            break;
+        }
+    }
+    return true;
+}
+
+static int display_mailbox_count(const app_config_t *config)
+{
+    return config->num_widgets < update_mailbox_slots() ? config->num_widgets : update_mailbox_slots();
+}
+
+// Widget a batch member is keyed by: its name, or else its index in the config
+static int display_batch_widget(const app_config_t *config, const payload_member_t *member)
+{
+    if (!member->key) {
+        return member->index < config->num_widgets ? member->index : -1;
+    }
+    for (int i = 0; i < config->num_widgets; i++) {
+        const char *name = config->widgets[i].name;
+        if (strlen(name) == member->key_len && memcmp(name, member->key, member->key_len) == 0) {
+            return i;
+        }
+    }
+    int index = 0;
+    for (size_t i = 0; i < member->key_len; i++) {
+        char c = member->key[i];
+        if (c < '0' || c > '9' || index >= config->num_widgets) return -1;
+        index = index * 10 + (c - '0');
+    }
+    return member->key_len > 0 && index < config->num_widgets ? index : -1;
+}
+
+// Apply a batch topic payload: an object whose members are the payloads of
+// the widgets they are keyed by. The whole payload is checked before any
+// widget changes, so the batch lands in one frame or not at all. Returns
+// true if any widget changed.
+static bool display_apply_batch(const app_config_t *config, const char *data, size_t len, payload_encoding_t encoding,
+                                int64_t arrived_us)
+{
+    static payload_member_t members[DISPLAY_BATCH_MAX_MEMBERS];
+
+    int count = payload_split(encoding, data, len, members, DISPLAY_BATCH_MAX_MEMBERS);
+    if (count < 0) {
+        stats.batches_rejected++;
+        ESP_LOGE(TAG, "Failed to parse batch payload");
+        return false;
+    }
+    bool changed = false;
+    for (int m = 0; m < count; m++) {
+        int i = display_batch_widget(config, &members[m]);
+        if (i < 0) {
+            ESP_LOGW(TAG, "Batch member %.*s names no widget", (int)members[m].key_len, members[m].key ? members[m].key : "");
+            continue;
+        }
+        if (display_apply_payload(config, i, members[m].value, members[m].value_len, encoding)) {
+            if (!widget_state[i].dirty) widget_state[i].arrived_us = arrived_us;
+            display_mark_changed(config, i);
+            changed = true;
+        }
+    }
+    stats.batches++;
+    return changed;
+}
 
-    cJSON *root = cJSON_Parse(data);
-    if (root == NULL) {
-        ESP_LOGE(TAG, "Failed to parse widget data JSON");
+// Parse every pending mailbox slot into the widget store and mark the
+// widgets that changed. Returns the number of posts folded in.
+static uint32_t display_drain_mailbox(const app_config_t *config)
+{
+    static char payload[UPDATE_MAILBOX_MAX_SLOT_SIZE];
+
+    uint32_t updates = 0;
+    update_mailbox_info_t info;
+    alloc_probe_enter(ALLOC_PROBE_PARSE);
+    for (int i = 0; i < display_mailbox_count(config); i++) {
+        if (update_mailbox_take(i, payload, UPDATE_MAILBOX_MAX_SLOT_SIZE, &info)) {
+            updates += info.posts;
+            if (display_apply_payload(config, i, payload, info.len, (payload_encoding_t)info.format)) {
+                if (!widget_state[i].dirty) widget_state[i].arrived_us = info.first_post_us;
+                display_mark_changed(config, i);
+            }
+        }
+    }
+    // The batch slot follows the widgets' slots
+    if (update_mailbox_take(config->num_widgets, payload, UPDATE_MAILBOX_MAX_SLOT_SIZE, &info)) {
+        updates += info.posts;
+        display_apply_batch(config, payload, info.len, (payload_encoding_t)info.format, info.first_post_us);
+    }
+    alloc_probe_exit(ALLOC_PROBE_PARSE);
+    return updates;
+}
+
+// Hold the first frame until the MQTT client reports every retained value
+// in, their burst has gone quiet after the last SUBACK, or the startup
+// timeout passes. Payloads are applied meanwhile, so the frame shows the
+// whole dashboard in one refresh instead of one per message.
+static void display_startup_phase(void)
+{
+    if (!startup_holding) {
         return;
     }
+    const app_config_t *config = get_config();
+    uint32_t updates = 0;
+    while (startup_holding) {
+        int64_t remaining_ms = (startup_deadline_us - esp_timer_get_time()) / 1000;
+        if (remaining_ms <= 0) {
+            stats.startup_timed_out = 1;
+            ESP_LOGW(TAG, "Startup timeout, drawing without every retained value");
+            break;
+        }
+        bool settling = startup_subscribed;
+        int64_t wait_ms = settling && remaining_ms > DISPLAY_STARTUP_SETTLE_MS ? DISPLAY_STARTUP_SETTLE_MS : remaining_ms;
+        bool woken = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms)) != 0;
+        updates += display_drain_mailbox(config);
+        if (!woken && settling) {
+            break;
+        }
+    }
+    startup_holding = false;
+    updates += display_drain_mailbox(config);
+
+    bool refreshed;
+    if (full_render_requested) {
+        full_render_requested = false;
+        display_render_frame(config);
+        refreshed = true;
+    } else {
+        refreshed = display_render_dirty(config);
+    }
+    if (refreshed) stats.refreshes++;
+    stats.startup_updates = updates;
+    stats.startup_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    ESP_LOGI(TAG, "First frame after %u ms with %u update(s)", (unsigned)stats.startup_ms, (unsigned)updates);
 
-    // Parse data based on widget type
-    if (strcmp(widget->type, "info_card") == 0) {
-        info_card_data_t *d = &widget_data_store[widget_index].info_card;
-        cJSON *value = cJSON_GetObjectItem(root, "value");
-        if (cJSON_IsString(value)) strncpy(d->value, value->valuestring, sizeof(d->value) - 1);
-        cJSON *unit = cJSON_GetObjectItem(root, "unit");
-        if (cJSON_IsString(unit)) strncpy(d->unit, unit->valuestring, sizeof(d->unit) - 1);
-    } else if (strcmp(widget->type, "weather_card") == 0) {
-        weather_card_data_t *d = &widget_data_store[widget_index].weather_card;
-        cJSON *value = cJSON_GetObjectItem(root, "value");
-        if (cJSON_IsString(value)) strncpy(d->value, value->valuestring, sizeof(d->value) - 1);
-        cJSON *unit = cJSON_GetObjectItem(root, "unit");
-        if (cJSON_IsString(unit)) strncpy(d->unit, unit->valuestring, sizeof(d->unit) - 1);
-        cJSON *icon = cJSON_GetObjectItem(root, "icon");
-        if (cJSON_IsString(icon)) strncpy(d->icon, icon->valuestring, sizeof(d->icon) - 1);
-    } else if (strcmp(widget->type, "list") == 0) {
-        list_widget_data_t *d = &widget_data_store[widget_index].list_widget;
-        cJSON *items = cJSON_GetObjectItem(root, "items");
-        d->num_items = cJSON_GetArraySize(items);
-        if (d->num_items > 10) d->num_items = 10;
-        for (int i = 0; i < d->num_items; i++) {
-            cJSON *item = cJSON_GetArrayItem(items, i);
-            cJSON *label = cJSON_GetObjectItem(item, "label");
-            if (cJSON_IsString(label)) strncpy(d->items[i].label, label->valuestring, sizeof(d->items[i].label) - 1);
-            cJSON *value = cJSON_GetObjectItem(item, "value");
-            if (cJSON_IsString(value)) strncpy(d->items[i].value, value->valuestring, sizeof(d->items[i].value) - 1);
+    // A button pressed meanwhile is served by the main loop
+    if (requested_page >= 0) {
+        xTaskNotifyGive(render_task);
+    }
+}
+
+// Drains the update mailbox: every dirty slot is parsed, then all changes
+// go to the panel in one frame
+static void display_render_task(void *arg)
+{
+    display_startup_phase();
+
+    for (;;) {
+        const app_config_t *config = get_config();
+        int prerender = display_prerender_candidate(config);
+        TickType_t idle = prerender >= 0 ? pdMS_TO_TICKS(DISPLAY_PRERENDER_IDLE_MS) : display_snapshot_wait();
+        if (!display_wait_for_updates(&config->display, idle)) {
+            display_compact_history(config);
+            if (prerender >= 0) {
+                display_prerender(config, prerender);
+            } else {
+                display_save_snapshot(config);
+            }
+            continue;
+        }
+
+        int page;
+        int64_t pressed_us;
+        if (display_take_page_request(&page, &pressed_us)) {
+            display_flip_page(config, page, pressed_us);
+        }
+
+        int count = display_mailbox_count(config);
+        uint32_t updates = display_drain_mailbox(config);
+
+        // Snapshot which widgets this frame commits, for the latency histogram
+        for (int i = 0; i < count; i++) {
+            widget_state[i].committed = widget_state[i].dirty;
+        }
+
+        bool refreshed;
+        if (full_render_requested) {
+            full_render_requested = false;
+            display_render_frame(config);
+            refreshed = true;
+        } else {
+            refreshed = display_render_dirty(config);
+        }
+        // A steady stream of updates never lets the task go idle
+        display_compact_history(config);
+        display_save_snapshot(config);
+        if (!refreshed || updates == 0) {
+            continue;
+        }
+
+        int64_t now = esp_timer_get_time();
+        stats.refreshes++;
+        stats.updates_per_refresh[display_hist_bucket(updates, updates_bounds)]++;
+        for (int i = 0; i < count; i++) {
+            if (widget_state[i].committed) {
+                uint32_t latency_ms = (uint32_t)((now - widget_state[i].arrived_us) / 1000);
+                stats.latency_ms[display_hist_bucket(latency_ms, latency_bounds)]++;
+            }
         }
     }
+}
 
-    cJSON_Delete(root);
+extern "C" void display_get_stats(display_stats_t *out)
+{
+    *out = stats;
+}
+
+extern "C" void display_render_widgets(void)
+{
+    const app_config_t *config = get_config();
+    if (!config) {
+        ESP_LOGE(TAG, "Cannot render widgets, config not loaded");
+        return;
+    }
+    if (!display_state_ready(config)) {
+        ESP_LOGE(TAG, "Cannot render widgets, no widget state");
+        return;
+    }
+
+    if (snapshot_restored && display_config_current()) {
+        ESP_LOGI(TAG, "Panel already shows the restored snapshot");
+        return;
+    }
+
+    if (render_task) {
+        full_render_requested = true;
+        xTaskNotifyGive(render_task);
+        return;
+    }
+    display_render_frame(config);
+}
+
+extern "C" void display_startup_subscribed(void)
+{
+    if (startup_holding && !startup_subscribed) {
+        startup_subscribed = true;
+        xTaskNotifyGive(render_task);
+    }
+}
+
+extern "C" void display_startup_complete(void)
+{
+    if (startup_holding) {
+        startup_holding = false;
+        xTaskNotifyGive(render_task);
+    }
+}
+
+extern "C" bool display_startup_holding(void)
+{
+    return startup_holding;
+}
 
-    // For simplicity, we redraw all widgets on any update.
-    display_render_widgets();
+extern "C" bool display_restored_from_snapshot(void)
+{
+    return restored_at_boot;
+}
+
+extern "C" int display_page_count(void)
+{
+    const app_config_t *config = get_config();
+    return config && config->num_pages > 1 ? config->num_pages : 1;
+}
+
+extern "C" void display_show_page(int page, int64_t pressed_us)
+{
+    const app_config_t *config = get_config();
+    if (!config || !display_state_ready(config) || page < 0 || page >= display_page_count()) {
+        return;
+    }
+
+    if (render_task) {
+        taskENTER_CRITICAL(&page_lock);
+        requested_page = page;
+        requested_pressed_us = pressed_us;
+        taskEXIT_CRITICAL(&page_lock);
+        xTaskNotifyGive(render_task);
+        return;
+    }
+    display_flip_page(config, page, pressed_us);
+}
+
+extern "C" void display_step_page(int delta, int64_t pressed_us)
+{
+    int n = display_page_count();
+    // Relative to a flip still pending, so quick presses are not lost
+    taskENTER_CRITICAL(&page_lock);
+    int base = requested_page >= 0 ? requested_page : current_page;
+    taskEXIT_CRITICAL(&page_lock);
+    display_show_page(((base + delta) % n + n) % n, pressed_us);
+}
+
+extern "C" void display_update_widget_by_topic(const char *topic, size_t topic_len, const char *data, size_t len,
+                                               payload_encoding_t encoding)
+{
+    const app_config_t *config = get_config();
+    if (!config || !display_state_ready(config)) {
+        return;
+    }
+
+    uint16_t targets[TOPIC_ROUTER_MAX_FANOUT];
+    int matched = topic_router_match(topic, topic_len, targets, TOPIC_ROUTER_MAX_FANOUT);
+    if (matched == 0) {
+        ESP_LOGW(TAG, "No widget found for topic: %.*s", (int)topic_len, topic);
+        return;
+    }
+    if (matched > TOPIC_ROUTER_MAX_FANOUT) {
+        ESP_LOGW(TAG, "Topic %.*s matches %d widgets, updating the first %d", (int)topic_len, topic, matched, TOPIC_ROUTER_MAX_FANOUT);
+        matched = TOPIC_ROUTER_MAX_FANOUT;
+    }
+    if (len > UPDATE_MAILBOX_MAX_SLOT_SIZE) {
+        stats.payloads_dropped++;
+        ESP_LOGW(TAG, "Payload of %u bytes on %.*s is too large", (unsigned)len, (int)topic_len, topic);
+        return;
+    }
+
+    bool changed = false;
+    for (int i = 0; i < matched; i++) {
+        int widget_index = targets[i];
+        if (render_task) {
+            // Never blocks: copies into the widget's (or the batch) slot and wakes the render task
+            if (!update_mailbox_post(widget_index, data, len, (uint8_t)encoding)) stats.payloads_dropped++;
+        } else if (widget_index == config->num_widgets) {
+            // Batch topic: every widget it updates goes into the one frame below
+            changed |= display_apply_batch(config, data, len, encoding, esp_timer_get_time());
+        } else if (display_apply_payload(config, widget_index, data, len, encoding)) {
+            display_mark_changed(config, widget_index);
+            changed = true;
+        }
+    }
+    if (changed) {
+        display_render_dirty(config);
+        display_save_snapshot(config);
+    }
 }
 
 extern "C" void display_default_view(void)
@@ -211,5 +1653,6 @@ extern "C" void display_default_view(void)
     display_print("eframe");
 
     display_update();
+    frame_on_panel = false;
     ESP_LOGI(TAG, "Default view displayed");
 }
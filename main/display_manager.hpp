@@ -2,15 +2,73 @@
 #define DISPLAY_MANAGER_HPP
 
 #include "config_types.h"
+#include "canvas.h"
+#include "json_extract.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#define DISPLAY_HIST_BUCKETS 8
+
+// Refresh statistics. Bucket upper bounds:
+//   updates_per_refresh: 1, 2, 4, 8, 16, 32, 64, more
+//   latency_ms (message arrival to refresh done): 100, 250, 500, 1000, 2000, 5000, 10000, more
+//   flip_ms (button press to panel upload start): 25, 50, 100, 250, 500, 1000, 2000, more
+typedef struct {
+    uint32_t updates_applied;       // updates that changed what a widget shows
+    uint32_t updates_suppressed;    // identical or within the widget's deadband
+    uint32_t refreshes;
+    uint32_t updates_per_refresh[DISPLAY_HIST_BUCKETS];
+    uint32_t latency_ms[DISPLAY_HIST_BUCKETS];
+    uint32_t page_flips;
+    uint32_t page_cache_hits;       // flips served from the page cache
+    uint32_t flip_ms[DISPLAY_HIST_BUCKETS];
+    uint32_t last_flip_ms;
+    uint32_t restore_ms;            // boot snapshot load, 0 if none was restored
+    uint32_t payloads_dropped;      // larger than the widget type's mailbox slot
+    uint32_t batches;               // batch topic payloads applied
+    uint32_t batches_rejected;      // malformed, nothing of them applied
+    uint32_t startup_ms;            // boot to the first complete frame, 0 without the startup barrier
+    uint32_t startup_updates;       // payloads folded into that frame
+    uint32_t startup_timed_out;     // 1 if it was drawn because startup_timeout_ms ran out
+} display_stats_t;
+
 void display_init(void);
 void display_render_widgets(void);
 void display_default_view(void);
-void display_update_widget_by_topic(const char *topic, const char *data);
+// Route a message to the widgets subscribed to topic. Neither topic nor data
+// need be NUL-terminated. Without allocating, data is copied into the
+// widgets' mailbox slots before this returns, or parsed in place when there
+// is no render task.
+void display_update_widget_by_topic(const char *topic, size_t topic_len, const char *data, size_t len,
+                                    payload_encoding_t encoding);
+
+// Startup barrier. Until released, or display.startup_timeout_ms after
+// display_init(), payloads are applied without drawing so the first frame
+// shows the whole dashboard in one refresh. The MQTT client reports when
+// every subscription is acknowledged (retained values follow right after;
+// the barrier lifts once they stop arriving) and when each has delivered.
+void display_startup_subscribed(void);
+void display_startup_complete(void);
+bool display_startup_holding(void);
+// Whether boot restored the widget data from the flash snapshot, so the
+// retained values need not be fetched again
+bool display_restored_from_snapshot(void);
+
+// Page navigation. pressed_us is the esp_timer time of the button press
+// behind the request, for the flip latency metric; 0 if there is none.
+int display_page_count(void);
+void display_show_page(int page, int64_t pressed_us);
+void display_step_page(int delta, int64_t pressed_us);
+
+// Canvas over the panel framebuffer, e.g. as a target for dither_push_row()
+void display_get_canvas(canvas_t *canvas);
+
+void display_get_stats(display_stats_t *stats);
 
 #ifdef __cplusplus
 }
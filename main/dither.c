@@ -0,0 +1,180 @@
+#include "dither.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t bayer8[8][8] = {
+    { 0, 32,  8, 40,  2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44,  4, 36, 14, 46,  6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    { 3, 35, 11, 43,  1, 33,  9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47,  7, 39, 13, 45,  5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21},
+};
+
+static inline bool needs_error_rows(dither_mode_t mode)
+{
+    return mode == DITHER_FLOYD_STEINBERG || mode == DITHER_ATKINSON;
+}
+
+static inline int clamp_gray(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+size_t dither_scratch_size(int w, dither_mode_t mode)
+{
+    if (!needs_error_rows(mode) || w <= 0) return 0;
+    return 2 * (size_t)(w + 2) * sizeof(int16_t);
+}
+
+bool dither_begin(dither_t *d, canvas_t *canvas, int x, int y, int w, int h,
+                  dither_mode_t mode, void *scratch)
+{
+    memset(d, 0, sizeof(*d));
+    if (!canvas || w <= 0 || h <= 0) return false;
+
+    d->canvas = canvas;
+    d->mode = mode;
+    d->x = x;
+    d->y = y;
+    d->w = w;
+    d->h = h;
+    d->vis_x0 = x < 0 ? -x : 0;
+    d->vis_x1 = (x + w > canvas->width) ? canvas->width - x : w;
+
+    size_t size = dither_scratch_size(w, mode);
+    if (size > 0) {
+        if (!scratch) {
+            scratch = d->owned = malloc(size);
+            if (!scratch) return false;
+        }
+        memset(scratch, 0, size);
+        d->err_cur = (int16_t *)scratch;
+        d->err_next = d->err_cur + w + 2;
+    }
+    return true;
+}
+
+void dither_end(dither_t *d)
+{
+    free(d->owned);
+    d->owned = NULL;
+    d->err_cur = d->err_next = NULL;
+}
+
+// Emit pixel i of the region if it lands on the canvas
+static inline void emit(const dither_t *d, canvas_cursor_t *c, bool visible, int i, bool black)
+{
+    if (visible && i >= d->vis_x0 && i < d->vis_x1) canvas_cursor_put(c, black);
+}
+
+static void row_threshold(dither_t *d, const uint8_t *gray, canvas_cursor_t *c, bool visible)
+{
+    for (int i = 0; i < d->w; i++) {
+        emit(d, c, visible, i, gray[i] < 128);
+    }
+}
+
+static void row_bayer(dither_t *d, const uint8_t *gray, canvas_cursor_t *c, bool visible)
+{
+    // Index the matrix by absolute position so adjacent regions tile seamlessly
+    const uint8_t *m = bayer8[(d->y + d->row) & 7];
+    for (int i = 0; i < d->w; i++) {
+        int threshold = m[(d->x + i) & 7] * 4 + 2;
+        emit(d, c, visible, i, gray[i] < threshold);
+    }
+}
+
+// Error rows hold numerators (sixteenths for Floyd-Steinberg, eighths for
+// Atkinson). Each slot of err_cur is reused as soon as it has been read, so
+// the two rows rotate without ever holding a third.
+static void row_floyd_steinberg(dither_t *d, const uint8_t *gray, canvas_cursor_t *c, bool visible)
+{
+    int16_t *cur = d->err_cur + 1;
+    int16_t *next = d->err_next + 1;
+    int carry = 0;
+
+    for (int i = 0; i < d->w; i++) {
+        int v = clamp_gray(gray[i] + ((cur[i] + carry) >> 4));
+        cur[i] = 0;
+        bool black = v < 128;
+        int e = black ? v : v - 255;
+        emit(d, c, visible, i, black);
+
+        carry = e * 7;
+        next[i - 1] += (int16_t)(e * 3);
+        next[i] += (int16_t)(e * 5);
+        next[i + 1] += (int16_t)e;
+    }
+}
+
+static void row_atkinson(dither_t *d, const uint8_t *gray, canvas_cursor_t *c, bool visible)
+{
+    int16_t *cur = d->err_cur + 1;
+    int16_t *next = d->err_next + 1;
+    int carry1 = 0;     // pending error for i
+    int carry2 = 0;     // pending error for i + 1
+
+    for (int i = 0; i < d->w; i++) {
+        int v = clamp_gray(gray[i] + ((cur[i] + carry1) >> 3));
+        bool black = v < 128;
+        int e = black ? v : v - 255;
+        emit(d, c, visible, i, black);
+
+        carry1 = carry2 + e;
+        carry2 = e;
+        next[i - 1] += (int16_t)e;
+        next[i] += (int16_t)e;
+        next[i + 1] += (int16_t)e;
+        cur[i] = (int16_t)e;    // two rows down, same column
+    }
+}
+
+bool dither_push_row(dither_t *d, const uint8_t *gray)
+{
+    if (d->row >= d->h) return false;
+
+    int cy = d->y + d->row;
+    bool visible = cy >= 0 && cy < d->canvas->height && d->vis_x0 < d->vis_x1;
+    canvas_cursor_t c = {0};
+    if (visible) c = canvas_cursor_at(d->canvas, d->x + d->vis_x0, cy);
+
+    switch (d->mode) {
+        case DITHER_BAYER:
+            row_bayer(d, gray, &c, visible);
+            break;
+        case DITHER_FLOYD_STEINBERG:
+            row_floyd_steinberg(d, gray, &c, visible);
+            break;
+        case DITHER_ATKINSON:
+            row_atkinson(d, gray, &c, visible);
+            break;
+        case DITHER_THRESHOLD:
+        default:
+            row_threshold(d, gray, &c, visible);
+            break;
+    }
+
+    if (needs_error_rows(d->mode)) {
+        int16_t *tmp = d->err_cur;
+        d->err_cur = d->err_next;
+        d->err_next = tmp;
+        // The guard slots only ever collect spill-over, keep them from piling up
+        d->err_cur[0] = d->err_cur[d->w + 1] = 0;
+        d->err_next[0] = d->err_next[d->w + 1] = 0;
+    }
+
+    d->row++;
+    return true;
+}
+
+dither_mode_t dither_mode_from_string(const char *name)
+{
+    if (!name) return DITHER_THRESHOLD;
+    if (strcmp(name, "bayer") == 0) return DITHER_BAYER;
+    if (strcmp(name, "floyd_steinberg") == 0) return DITHER_FLOYD_STEINBERG;
+    if (strcmp(name, "atkinson") == 0) return DITHER_ATKINSON;
+    return DITHER_THRESHOLD;
+}
@@ -0,0 +1,54 @@
+#ifndef DITHER_H
+#define DITHER_H
+
+#include "canvas.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    DITHER_THRESHOLD = 0,
+    DITHER_BAYER,               // 8x8 ordered
+    DITHER_FLOYD_STEINBERG,
+    DITHER_ATKINSON,
+} dither_mode_t;
+
+// Streaming 8-bit grayscale (0 = black, 255 = white) to 1bpp converter.
+// Rows are pushed one at a time and written straight into a canvas region;
+// error diffusion keeps only two rows of error state, never the image.
+typedef struct {
+    canvas_t *canvas;
+    dither_mode_t mode;
+    int x, y, w, h;     // destination region, may extend past the canvas
+    int vis_x0, vis_x1; // visible column range within the region
+    int row;            // next row to be pushed
+    int16_t *err_cur;   // error numerators for the current row (w + 2 entries)
+    int16_t *err_next;  // error numerators for the following row
+    void *owned;        // scratch allocated by dither_begin, if any
+} dither_t;
+
+// Bytes of scratch needed for a region of the given width
+size_t dither_scratch_size(int w, dither_mode_t mode);
+
+// Start a conversion. scratch may be NULL, in which case it is allocated
+// from the heap when the mode needs it and released by dither_end().
+bool dither_begin(dither_t *d, canvas_t *canvas, int x, int y, int w, int h,
+                  dither_mode_t mode, void *scratch);
+
+// Convert one row of w gray pixels, returns false once the region is full
+bool dither_push_row(dither_t *d, const uint8_t *gray);
+
+void dither_end(dither_t *d);
+
+// Map a config string ("bayer", "floyd_steinberg", "atkinson", "threshold")
+dither_mode_t dither_mode_from_string(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DITHER_H
@@ -0,0 +1,479 @@
+#include "histlog.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#include "esp_partition.h"
+#else
+// Host builds, for replaying and inspecting logs pulled off a device
+#include <stdio.h>
+#define ESP_LOGI(tag, fmt, ...) printf("I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) printf("W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...) printf("E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#endif
+
+static const char *TAG = "HISTLOG";
+
+#define HISTLOG_MAGIC 0x48534c47u   // "HSLG"
+// First segment of a complete compaction run; only clears bits of HISTLOG_MAGIC
+#define HISTLOG_MAGIC_BASE 0x48534c42u  // "HSLB"
+#define PAGE_UNWRITTEN 0xFFFF
+
+typedef struct {
+    uint32_t first_ts;
+    uint16_t count;     // PAGE_UNWRITTEN until the page has been programmed
+    uint16_t crc;
+} page_desc_t;
+
+// Start of a segment's first page
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    page_desc_t pages[HISTLOG_PAGES_PER_SEGMENT];
+} segment_header_t;
+
+static struct {
+    histlog_flash_t flash;
+    bool mounted;
+    int segments;
+    int head;               // segment being filled
+    uint32_t head_seq;
+    int head_page;          // next data page in it
+    int span;               // segments from the last base to the head, both included
+    int run_start;          // first segment of the compaction run being written
+    uint32_t run_records;
+    bool based;             // a base is within span
+    bool compacting;
+    bool compact_failed;
+    uint32_t last_ts;
+    histlog_record_t pending[HISTLOG_RECORDS_PER_PAGE];
+    int pending_count;
+    histlog_stats_t stats;
+} hl;
+
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)(data[i] << 8);
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static size_t segment_offset(int segment)
+{
+    return (size_t)segment * HISTLOG_SECTOR_SIZE;
+}
+
+static size_t page_offset(int segment, int page)
+{
+    return segment_offset(segment) + (size_t)(page + 1) * HISTLOG_PAGE_SIZE;
+}
+
+static bool read_header(int segment, segment_header_t *header)
+{
+    return hl.flash.read(hl.flash.ctx, segment_offset(segment), header, sizeof(*header)) &&
+           (header->magic == HISTLOG_MAGIC || header->magic == HISTLOG_MAGIC_BASE);
+}
+
+static bool page_blank(int segment, int page)
+{
+    uint8_t buf[HISTLOG_PAGE_SIZE];
+    if (!hl.flash.read(hl.flash.ctx, page_offset(segment, page), buf, sizeof(buf))) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        if (buf[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+// Read a data page and check it against its descriptor, returns the record count
+static int read_page(int segment, int page, const page_desc_t *desc, histlog_record_t *records)
+{
+    if (desc->count == PAGE_UNWRITTEN || desc->count == 0 || desc->count > HISTLOG_RECORDS_PER_PAGE) {
+        return 0;
+    }
+    size_t len = desc->count * sizeof(histlog_record_t);
+    if (!hl.flash.read(hl.flash.ctx, page_offset(segment, page), records, len) ||
+        crc16((const uint8_t *)records, len) != desc->crc) {
+        hl.stats.pages_corrupt++;
+        return 0;
+    }
+    return desc->count;
+}
+
+// Erase the segment after the head, overwriting the oldest data once the ring is full
+static bool open_segment(int segment, uint32_t seq)
+{
+    if (!hl.flash.erase(hl.flash.ctx, segment_offset(segment), HISTLOG_SECTOR_SIZE)) {
+        hl.stats.write_errors++;
+        return false;
+    }
+    hl.stats.segments_erased++;
+
+    segment_header_t header;
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = HISTLOG_MAGIC;
+    header.seq = seq;
+    if (!hl.flash.write(hl.flash.ctx, segment_offset(segment), &header, offsetof(segment_header_t, pages))) {
+        hl.stats.write_errors++;
+        return false;
+    }
+    hl.head = segment;
+    hl.head_seq = seq;
+    hl.head_page = 0;
+    hl.span++;
+    return true;
+}
+
+// Newest timestamp in the segment, 0 if it holds no readable page
+static uint32_t segment_last_ts(int segment, const segment_header_t *header)
+{
+    histlog_record_t records[HISTLOG_RECORDS_PER_PAGE];
+    for (int page = HISTLOG_PAGES_PER_SEGMENT - 1; page >= 0; page--) {
+        int n = read_page(segment, page, &header->pages[page], records);
+        if (n > 0) {
+            uint32_t last = 0;
+            for (int i = 0; i < n; i++) {
+                if (records[i].t > last) last = records[i].t;
+            }
+            return last;
+        }
+    }
+    return 0;
+}
+
+bool histlog_mount(const histlog_flash_t *flash)
+{
+    memset(&hl, 0, sizeof(hl));
+    hl.flash = *flash;
+    hl.segments = (int)(flash->size / HISTLOG_SECTOR_SIZE);
+    if (hl.segments < 2) {
+        ESP_LOGE(TAG, "Log needs at least two segments, partition has %d", hl.segments);
+        return false;
+    }
+
+    // The head is the segment with the highest sequence number
+    int head = -1;
+    segment_header_t header;
+    for (int s = 0; s < hl.segments; s++) {
+        if (read_header(s, &header) && (head < 0 || (int32_t)(header.seq - hl.head_seq) > 0)) {
+            head = s;
+            hl.head_seq = header.seq;
+        }
+    }
+
+    if (head < 0) {
+        ESP_LOGI(TAG, "No log found, formatting %d segments", hl.segments);
+        hl.mounted = open_segment(0, 1);
+        return hl.mounted;
+    }
+
+    for (int back = 0; back < hl.segments; back++) {
+        int s = (head + hl.segments - back) % hl.segments;
+        if (!read_header(s, &header) || header.seq != hl.head_seq - (uint32_t)back) break;
+        hl.span++;
+        hl.based = header.magic == HISTLOG_MAGIC_BASE;
+        if (hl.based) break;
+    }
+
+    // Skip pages that were programmed but never got their descriptor (torn writes)
+    hl.head = head;
+    read_header(head, &header);
+    int page = 0;
+    while (page < HISTLOG_PAGES_PER_SEGMENT && header.pages[page].count != PAGE_UNWRITTEN) page++;
+    while (page < HISTLOG_PAGES_PER_SEGMENT && !page_blank(head, page)) {
+        page_desc_t burnt = { 0, 0, 0 };
+        hl.flash.write(hl.flash.ctx, segment_offset(head) + offsetof(segment_header_t, pages) + page * sizeof(page_desc_t),
+                       &burnt, sizeof(burnt));
+        hl.stats.pages_corrupt++;
+        page++;
+    }
+    hl.head_page = page;
+
+    hl.last_ts = segment_last_ts(head, &header);
+    int prev = (head + hl.segments - 1) % hl.segments;
+    if (hl.last_ts == 0 && read_header(prev, &header) && header.seq == hl.head_seq - 1) {
+        hl.last_ts = segment_last_ts(prev, &header);
+    }
+
+    hl.mounted = hl.head_page < HISTLOG_PAGES_PER_SEGMENT || open_segment((head + 1) % hl.segments, hl.head_seq + 1);
+    ESP_LOGI(TAG, "Mounted: %d segments, head %d (seq %u) page %d, %d since base, last timestamp %u",
+             hl.segments, hl.head, (unsigned)hl.head_seq, hl.head_page, hl.span, (unsigned)hl.last_ts);
+    return hl.mounted;
+}
+
+bool histlog_mounted(void)
+{
+    return hl.mounted;
+}
+
+uint32_t histlog_last_timestamp(void)
+{
+    return hl.last_ts;
+}
+
+void histlog_flush(void)
+{
+    if (!hl.mounted || hl.pending_count == 0) {
+        return;
+    }
+
+    uint8_t page[HISTLOG_PAGE_SIZE];
+    size_t len = (size_t)hl.pending_count * sizeof(histlog_record_t);
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, hl.pending, len);
+
+    page_desc_t desc = {
+        .first_ts = hl.pending[0].t,
+        .count = (uint16_t)hl.pending_count,
+        .crc = crc16(page, len),
+    };
+    size_t desc_offset = segment_offset(hl.head) + offsetof(segment_header_t, pages) + (size_t)hl.head_page * sizeof(page_desc_t);
+    // Data first: a descriptor is only ever programmed over a complete page
+    if (!hl.flash.write(hl.flash.ctx, page_offset(hl.head, hl.head_page), page, sizeof(page)) ||
+        !hl.flash.write(hl.flash.ctx, desc_offset, &desc, sizeof(desc))) {
+        hl.stats.write_errors++;
+    } else {
+        hl.stats.pages_written++;
+    }
+    hl.pending_count = 0;
+
+    if (++hl.head_page == HISTLOG_PAGES_PER_SEGMENT) {
+        hl.mounted = open_segment((hl.head + 1) % hl.segments, hl.head_seq + 1);
+    }
+}
+
+static void log_record(uint32_t id, uint32_t t, float value)
+{
+    histlog_record_t *r = &hl.pending[hl.pending_count++];
+    r->id = id;
+    r->t = t;
+    r->value = value;
+    if (hl.pending_count == HISTLOG_RECORDS_PER_PAGE) {
+        histlog_flush();
+    }
+}
+
+void histlog_append(uint32_t id, uint32_t t, float value)
+{
+    if (!hl.mounted || hl.compacting) {
+        return;
+    }
+    if (hl.pending_count > 0 && t - hl.pending[0].t >= HISTLOG_FLUSH_INTERVAL_S) {
+        histlog_flush();
+    }
+    if (t > hl.last_ts) hl.last_ts = t;
+    hl.stats.appended++;
+    log_record(id, t, value);
+}
+
+bool histlog_compaction_due(void)
+{
+    return hl.mounted && !hl.compacting && !hl.compact_failed && hl.span >= hl.segments / 2;
+}
+
+int histlog_compact_limit(void)
+{
+    return hl.mounted ? (int)(hl.segments / 4 * HISTLOG_PAGES_PER_SEGMENT * HISTLOG_RECORDS_PER_PAGE) : 0;
+}
+
+bool histlog_compact_begin(void)
+{
+    histlog_flush();
+    // A run starts on a fresh segment, so its base holds nothing older
+    if (hl.mounted && hl.head_page > 0) {
+        hl.mounted = open_segment((hl.head + 1) % hl.segments, hl.head_seq + 1);
+    }
+    if (!hl.mounted || hl.compacting) {
+        return false;
+    }
+    hl.compacting = true;
+    hl.run_start = hl.head;
+    hl.run_records = 0;
+    hl.span = 1;
+    return true;
+}
+
+void histlog_compact_add(uint32_t id, uint32_t t, float value)
+{
+    if (!hl.compacting) {
+        return;
+    }
+    // Any longer and the run would start overwriting the previous base
+    if (hl.span > hl.segments / 2) {
+        ESP_LOGE(TAG, "Compaction run outgrew half the log, abandoned after %u records", (unsigned)hl.run_records);
+        hl.compacting = false;
+        hl.compact_failed = true;
+        return;
+    }
+    log_record(id, t, value);
+    hl.run_records++;
+}
+
+bool histlog_compact_end(void)
+{
+    if (!hl.compacting) {
+        return false;
+    }
+    histlog_flush();
+    hl.compacting = false;
+
+    // Until the base is marked, replay reads past the run into the old records
+    uint32_t magic = HISTLOG_MAGIC_BASE;
+    if (!hl.mounted || !hl.flash.write(hl.flash.ctx, segment_offset(hl.run_start), &magic, sizeof(magic))) {
+        hl.stats.write_errors++;
+        return false;
+    }
+    hl.based = true;
+    hl.stats.compactions++;
+    hl.stats.records_compacted += hl.run_records;
+    return true;
+}
+
+int histlog_replay(int want, histlog_replay_fn fn, void *arg)
+{
+    if (!hl.mounted || want <= 0) {
+        return 0;
+    }
+
+    // Walk back through the index to the newest base, or without one until
+    // enough records are covered
+    segment_header_t header;
+    int back = 0;
+    int covered = 0;
+    while (back < hl.segments && (hl.based || covered < want)) {
+        int s = (hl.head + hl.segments - back) % hl.segments;
+        if (!read_header(s, &header) || header.seq != hl.head_seq - (uint32_t)back) {
+            break;
+        }
+        for (int p = 0; p < HISTLOG_PAGES_PER_SEGMENT; p++) {
+            if (header.pages[p].count != PAGE_UNWRITTEN) covered += header.pages[p].count;
+        }
+        back++;
+        // Everything older was rewritten into this run or superseded
+        if (header.magic == HISTLOG_MAGIC_BASE) break;
+    }
+
+    int replayed = 0;
+    histlog_record_t records[HISTLOG_RECORDS_PER_PAGE];
+    for (int k = back - 1; k >= 0; k--) {
+        int s = (hl.head + hl.segments - k) % hl.segments;
+        if (!read_header(s, &header)) {
+            continue;
+        }
+        for (int p = 0; p < HISTLOG_PAGES_PER_SEGMENT; p++) {
+            int n = read_page(s, p, &header.pages[p], records);
+            for (int i = 0; i < n; i++) {
+                fn(&records[i], arg);
+            }
+            replayed += n;
+        }
+    }
+    for (int i = 0; i < hl.pending_count; i++) {
+        fn(&hl.pending[i], arg);
+    }
+    return replayed + hl.pending_count;
+}
+
+void histlog_get_stats(histlog_stats_t *out)
+{
+    *out = hl.stats;
+}
+
+#ifdef ESP_PLATFORM
+
+static bool partition_read(void *ctx, size_t offset, void *buf, size_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, offset, buf, len) == ESP_OK;
+}
+
+static bool partition_write(void *ctx, size_t offset, const void *buf, size_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, offset, buf, len) == ESP_OK;
+}
+
+static bool partition_erase(void *ctx, size_t offset, size_t len)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, offset, len) == ESP_OK;
+}
+
+bool histlog_flash_partition(histlog_flash_t *flash, const char *label)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (!part) {
+        ESP_LOGW(TAG, "No '%s' partition, history will not persist", label);
+        return false;
+    }
+    flash->size = part->size;
+    flash->read = partition_read;
+    flash->write = partition_write;
+    flash->erase = partition_erase;
+    flash->ctx = (void *)part;
+    return true;
+}
+
+#else
+
+static bool file_read(void *ctx, size_t offset, void *buf, size_t len)
+{
+    FILE *f = (FILE *)ctx;
+    return fseek(f, (long)offset, SEEK_SET) == 0 && fread(buf, 1, len, f) == len;
+}
+
+// NOR flash can only clear bits, so a write ANDs into what is there
+static bool file_write(void *ctx, size_t offset, const void *buf, size_t len)
+{
+    FILE *f = (FILE *)ctx;
+    uint8_t chunk[HISTLOG_PAGE_SIZE];
+    const uint8_t *src = (const uint8_t *)buf;
+    while (len > 0) {
+        size_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        if (!file_read(ctx, offset, chunk, n)) return false;
+        for (size_t i = 0; i < n; i++) chunk[i] &= src[i];
+        if (fseek(f, (long)offset, SEEK_SET) != 0 || fwrite(chunk, 1, n, f) != n) return false;
+        offset += n;
+        src += n;
+        len -= n;
+    }
+    return fflush(f) == 0;
+}
+
+static bool file_erase(void *ctx, size_t offset, size_t len)
+{
+    FILE *f = (FILE *)ctx;
+    uint8_t blank[HISTLOG_PAGE_SIZE];
+    memset(blank, 0xFF, sizeof(blank));
+    if (fseek(f, (long)offset, SEEK_SET) != 0) return false;
+    for (size_t done = 0; done < len; done += sizeof(blank)) {
+        size_t n = len - done < sizeof(blank) ? len - done : sizeof(blank);
+        if (fwrite(blank, 1, n, f) != n) return false;
+    }
+    return fflush(f) == 0;
+}
+
+bool histlog_flash_file(histlog_flash_t *flash, const char *path, size_t size)
+{
+    FILE *f = fopen(path, "r+b");
+    if (!f) {
+        f = fopen(path, "w+b");
+        if (!f || !file_erase(f, 0, size)) {
+            if (f) fclose(f);
+            return false;
+        }
+    }
+    flash->size = size;
+    flash->read = file_read;
+    flash->write = file_write;
+    flash->erase = file_erase;
+    flash->ctx = f;
+    return true;
+}
+
+#endif
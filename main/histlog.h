@@ -0,0 +1,107 @@
+#ifndef HISTLOG_H
+#define HISTLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Append-only log of widget history samples in a raw flash partition.
+//
+// The partition is a ring of 4 KB segments, one per erase sector, reused
+// oldest first so every sector wears evenly. A segment's first page holds
+// its sequence number and an index with one descriptor per data page
+// (first timestamp, record count, CRC). Records are batched in RAM and
+// written a whole page at a time, then the page's descriptor is programmed;
+// a page without descriptor is treated as never written. At boot the index
+// alone tells how far back to read to refill the history rings.
+//
+// Records fall out of the history rings long before the ring of segments
+// overwrites them, so most of the log is superseded. Compaction rewrites the
+// records the rings still hold as a run of fresh segments; once the run is
+// complete its first segment is marked as a base. Replay reads from the
+// newest base on, which is at most half the log back. Compacting before the
+// ring wraps onto the last base keeps the samples of slow widgets from being
+// pushed out by fast ones.
+
+#define HISTLOG_SECTOR_SIZE       4096
+#define HISTLOG_PAGE_SIZE         256
+#define HISTLOG_PAGES_PER_SEGMENT (HISTLOG_SECTOR_SIZE / HISTLOG_PAGE_SIZE - 1)
+// Flush a partly filled page once its oldest record is this old
+#define HISTLOG_FLUSH_INTERVAL_S  300
+
+typedef struct {
+    uint32_t id;    // widget identity, stable across config edits that keep the name
+    uint32_t t;     // seconds on the log's clock
+    float value;
+} histlog_record_t;
+
+#define HISTLOG_RECORDS_PER_PAGE (HISTLOG_PAGE_SIZE / sizeof(histlog_record_t))
+
+// Flash access, so the same log code runs on a partition or a host file
+typedef struct {
+    size_t size;
+    bool (*read)(void *ctx, size_t offset, void *buf, size_t len);
+    bool (*write)(void *ctx, size_t offset, const void *buf, size_t len);
+    bool (*erase)(void *ctx, size_t offset, size_t len);
+    void *ctx;
+} histlog_flash_t;
+
+typedef struct {
+    uint32_t appended;
+    uint32_t pages_written;
+    uint32_t segments_erased;
+    uint32_t pages_corrupt;     // CRC mismatch or torn write found while reading
+    uint32_t write_errors;
+    uint32_t compactions;
+    uint32_t records_compacted;
+} histlog_stats_t;
+
+#ifdef ESP_PLATFORM
+// Data partition with the given label, e.g. "histlog"
+bool histlog_flash_partition(histlog_flash_t *flash, const char *label);
+#else
+// File standing in for a partition of size bytes with NOR semantics:
+// erase sets bytes to 0xFF, writes can only clear bits. Created if missing.
+bool histlog_flash_file(histlog_flash_t *flash, const char *path, size_t size);
+#endif
+
+bool histlog_mount(const histlog_flash_t *flash);
+bool histlog_mounted(void);
+
+// Timestamp of the newest record on flash, 0 for an empty log
+uint32_t histlog_last_timestamp(void);
+
+void histlog_append(uint32_t id, uint32_t t, float value);
+// Write out the partly filled page, if any
+void histlog_flush(void);
+
+// Call fn for the records from the newest base on or, if the log has none,
+// of the newest segments holding at least want records; oldest first
+typedef void (*histlog_replay_fn)(const histlog_record_t *record, void *arg);
+int histlog_replay(int want, histlog_replay_fn fn, void *arg);
+
+// True once the segments written since the last base fill half the ring
+bool histlog_compaction_due(void);
+// Most records a compaction run should carry: a quarter of the ring, so at
+// least another quarter is appended before the next one is due. Rings
+// holding more than this in total compact too often to bound the wear.
+int histlog_compact_limit(void);
+// Compaction: begin, add every record still worth keeping (each widget's
+// oldest first), end. Appending in between is not allowed. A run that
+// outgrows half the ring is abandoned and compaction is not tried again
+// until the next mount.
+bool histlog_compact_begin(void);
+void histlog_compact_add(uint32_t id, uint32_t t, float value);
+bool histlog_compact_end(void);
+
+void histlog_get_stats(histlog_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HISTLOG_H
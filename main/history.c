@@ -0,0 +1,146 @@
+#include "history.h"
+#include <math.h>
+
+void history_init(history_t *h, history_sample_t *storage, int capacity, float resolution)
+{
+    h->samples = storage;
+    h->capacity = (uint16_t)capacity;
+    h->head = 0;
+    h->count = 0;
+    h->first_ts = 0;
+    h->last_ts = 0;
+    h->base = 0;
+    h->resolution = resolution > 0 ? resolution : 1.0f;
+    h->revision = 0;
+}
+
+static int16_t quantise(const history_t *h, float value)
+{
+    float q = roundf((value - h->base) / h->resolution);
+    if (q > INT16_MAX) return INT16_MAX;
+    if (q < INT16_MIN) return INT16_MIN;
+    return (int16_t)q;
+}
+
+// Moves the base to the middle of the stored samples and value, so all of
+// them fit in int16 steps again. Only a ring spanning more than 65535 steps
+// still saturates, at both ends.
+static void rebase(history_t *h, float value)
+{
+    float lo = roundf((value - h->base) / h->resolution);
+    float hi = lo;
+    uint16_t oldest = (uint16_t)((h->head + h->capacity - h->count) % h->capacity);
+    uint16_t i = oldest;
+    for (int n = 0; n < h->count; n++) {
+        if (h->samples[i].q < lo) lo = h->samples[i].q;
+        if (h->samples[i].q > hi) hi = h->samples[i].q;
+        i = (uint16_t)((i + 1) % h->capacity);
+    }
+    float shift = roundf((lo + hi) / 2);
+    i = oldest;
+    for (int n = 0; n < h->count; n++) {
+        float q = h->samples[i].q - shift;
+        h->samples[i].q = (int16_t)(q > INT16_MAX ? INT16_MAX : q < INT16_MIN ? INT16_MIN : q);
+        i = (uint16_t)((i + 1) % h->capacity);
+    }
+    h->base += shift * h->resolution;
+}
+
+void history_push(history_t *h, uint32_t t, float value)
+{
+    if (h->capacity == 0) {
+        return;
+    }
+    if (h->count == 0) {
+        h->base = value;
+        h->first_ts = t;
+        h->last_ts = t;
+    } else if (fabsf(roundf((value - h->base) / h->resolution)) > INT16_MAX) {
+        rebase(h, value);
+    }
+
+    uint32_t dt = t > h->last_ts ? t - h->last_ts : 0;
+    if (h->count == h->capacity) {
+        // The sample after the evicted one becomes the oldest
+        uint16_t oldest = h->head;
+        uint16_t next = (uint16_t)((oldest + 1) % h->capacity);
+        h->first_ts += h->samples[next].dt;
+    } else {
+        h->count++;
+    }
+
+    history_sample_t *s = &h->samples[h->head];
+    s->dt = (uint16_t)(dt > UINT16_MAX ? UINT16_MAX : dt);
+    s->q = quantise(h, value);
+    h->head = (uint16_t)((h->head + 1) % h->capacity);
+    h->last_ts += s->dt;
+    if (h->count == 1) h->first_ts = h->last_ts;
+    h->revision++;
+}
+
+int history_decode(const history_t *h, history_point_t *out)
+{
+    uint16_t i = (uint16_t)((h->head + h->capacity - h->count) % (h->capacity ? h->capacity : 1));
+    uint32_t t = h->first_ts;
+    for (int n = 0; n < h->count; n++) {
+        if (n > 0) t += h->samples[i].dt;
+        out[n].t = t;
+        out[n].v = h->base + h->samples[i].q * h->resolution;
+        i = (uint16_t)((i + 1) % h->capacity);
+    }
+    return h->count;
+}
+
+int history_lttb(const history_point_t *in, int n, history_point_t *out, int threshold)
+{
+    if (threshold >= n || threshold < 3) {
+        int keep = threshold < 3 && threshold < n ? threshold : n;
+        for (int i = 0; i < keep; i++) out[i] = in[i];
+        return keep;
+    }
+
+    // First and last points are kept, the rest is split into threshold - 2 buckets
+    double every = (double)(n - 2) / (threshold - 2);
+    history_point_t a = in[0];
+    out[0] = a;
+    int selected = 1;
+
+    for (int b = 0; b < threshold - 2; b++) {
+        int start = (int)(b * every) + 1;
+        int end = (int)((b + 1) * every) + 1;
+        int next_end = (int)((b + 2) * every) + 1;
+        if (next_end > n) next_end = n;
+
+        // Average of the following bucket, the third triangle corner
+        double avg_t = 0, avg_v = 0;
+        int next_count = next_end - end;
+        if (next_count <= 0) {
+            avg_t = in[n - 1].t;
+            avg_v = in[n - 1].v;
+        } else {
+            for (int i = end; i < next_end; i++) {
+                avg_t += in[i].t;
+                avg_v += in[i].v;
+            }
+            avg_t /= next_count;
+            avg_v /= next_count;
+        }
+
+        double best_area = -1;
+        int best = start;
+        for (int i = start; i < end; i++) {
+            double area = fabs(((double)a.t - avg_t) * ((double)in[i].v - a.v) -
+                               ((double)a.t - in[i].t) * (avg_v - a.v));
+            if (area > best_area) {
+                best_area = area;
+                best = i;
+            }
+        }
+        // in[best] is never behind out[selected] when out == in, so a copy suffices
+        a = in[best];
+        out[selected++] = a;
+    }
+
+    out[selected++] = in[n - 1];
+    return selected;
+}
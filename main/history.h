@@ -0,0 +1,61 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Fixed-capacity time series of one widget's numeric value. Samples are 4
+// bytes: the seconds since the previous sample and the value quantised to
+// resolution steps around a base value. The base starts at the first value
+// and moves whenever a value would no longer fit, so a drifting series (an
+// energy meter's running total) keeps its resolution. The oldest sample is
+// overwritten once the ring is full.
+
+typedef struct {
+    uint16_t dt;    // seconds since the previous sample, saturates at 65535
+    int16_t q;      // (value - base) / resolution, saturating
+} history_sample_t;
+
+typedef struct {
+    history_sample_t *samples;  // caller-provided storage of capacity entries
+    uint16_t capacity;
+    uint16_t head;              // slot the next sample goes to
+    uint16_t count;
+    uint32_t first_ts;          // timestamp of the oldest sample
+    uint32_t last_ts;           // timestamp of the newest sample
+    float base;                 // value of q == 0, moved by history_push
+    float resolution;
+    uint32_t revision;          // bumped on every push
+} history_t;
+
+// Decoded sample
+typedef struct {
+    uint32_t t;
+    float v;
+} history_point_t;
+
+static inline size_t history_storage_size(int capacity)
+{
+    return (size_t)capacity * sizeof(history_sample_t);
+}
+
+void history_init(history_t *h, history_sample_t *storage, int capacity, float resolution);
+void history_push(history_t *h, uint32_t t, float value);
+
+// Decode all samples oldest first into out (capacity entries), returns the count
+int history_decode(const history_t *h, history_point_t *out);
+
+// Largest-triangle-three-buckets: pick at most threshold points of in that
+// keep the shape of the series. out may equal in. Returns the point count.
+int history_lttb(const history_point_t *in, int n, history_point_t *out, int threshold);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HISTORY_H
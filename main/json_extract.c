@@ -0,0 +1,1052 @@
+#include "json_extract.h"
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One level of the position in the document: an object member or an array element
+typedef struct {
+    const char *key;    // raw key text, NULL for an array element
+    size_t key_len;
+    int index;          // element index inside an array
+} path_entry_t;
+
+typedef struct {
+    const char *p;
+    const char *end;
+    const json_program_t *program;
+    uint8_t *out;
+    uint32_t changed;
+    uint32_t counted;   // COUNT fields whose array was found
+    path_entry_t path[JSON_EXTRACT_MAX_DEPTH];
+    int depth;
+} parser_t;
+
+static char lower(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (char)(c + 'a' - 'A') : c;
+}
+
+static bool key_equal(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    if (a_len != b_len) return false;
+    for (size_t i = 0; i < a_len; i++) {
+        if (lower(a[i]) != lower(b[i])) return false;
+    }
+    return true;
+}
+
+// Whether field i's path names the current position. *element gets the
+// index of the element a "[]" step stepped into, -1 if the path has none.
+static bool path_matches(const parser_t *ps, int i, int *element)
+{
+    const json_program_t *prog = ps->program;
+    if (prog->num_steps[i] != ps->depth) return false;
+    const json_step_t *steps = &prog->steps[prog->first_step[i]];
+    *element = -1;
+    // Deepest level first, it is where paths of one payload differ most
+    for (int level = ps->depth - 1; level >= 0; level--) {
+        const path_entry_t *e = &ps->path[level];
+        const json_step_t *s = &steps[level];
+        if (s->key) {
+            if (!e->key || !key_equal(e->key, e->key_len, s->key, s->key_len)) return false;
+        } else if (e->key) {
+            return false;
+        } else if (s->index < 0) {
+            *element = e->index;
+        } else if (s->index != e->index) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *field_target(const parser_t *ps, const json_field_t *f, int element)
+{
+    return ps->out + f->offset + (element > 0 ? (size_t)element * f->stride : 0);
+}
+
+// Text fields naming the current position, as a bit mask. Strings fill
+// STRING and SCALAR fields, numbers and booleans only SCALAR ones.
+static uint32_t text_fields_here(const parser_t *ps, bool is_string)
+{
+    const json_program_t *prog = ps->program;
+    uint32_t mask = 0;
+    if (ps->depth > prog->max_depth) return 0;
+    for (int i = 0; i < prog->num_fields; i++) {
+        int element;
+        const json_field_t *f = &prog->fields[i];
+        bool kind_ok = f->kind == JSON_FIELD_SCALAR || (is_string && f->kind == JSON_FIELD_STRING);
+        if (kind_ok && path_matches(ps, i, &element) && (element < 0 || element < f->max_items)) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+static void store_string(parser_t *ps, uint32_t mask, const char *value, size_t len)
+{
+    for (int i = 0; i < ps->program->num_fields; i++) {
+        if (!(mask & (1u << i))) continue;
+        const json_field_t *f = &ps->program->fields[i];
+        int element;
+        path_matches(ps, i, &element);
+        char *dst = (char *)field_target(ps, f, element);
+        size_t n = len < f->size - 1 ? len : f->size - 1;
+        if (strnlen(dst, f->size) != n || memcmp(dst, value, n) != 0) {
+            ps->changed |= 1u << i;
+        }
+        memcpy(dst, value, n);
+        memset(dst + n, 0, f->size - n);
+    }
+}
+
+// The array at the current position ended with count elements
+static void store_count(parser_t *ps, int count)
+{
+    for (int i = 0; i < ps->program->num_fields; i++) {
+        const json_field_t *f = &ps->program->fields[i];
+        int element;
+        if (f->kind != JSON_FIELD_COUNT || !path_matches(ps, i, &element)) continue;
+        int value = count < f->max_items ? count : f->max_items;
+        int *dst = (int *)field_target(ps, f, -1);
+        if (*dst != value) ps->changed |= 1u << i;
+        *dst = value;
+        ps->counted |= 1u << i;
+    }
+}
+
+static void skip_ws(parser_t *ps)
+{
+    while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n' || *ps->p == '\r')) ps->p++;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    c = lower(c);
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static bool read_hex4(parser_t *ps, uint32_t *out)
+{
+    if (ps->end - ps->p < 4) return false;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = hex_digit(ps->p[i]);
+        if (d < 0) return false;
+        v = (v << 4) | (uint32_t)d;
+    }
+    ps->p += 4;
+    *out = v;
+    return true;
+}
+
+static size_t put_utf8(char *dst, size_t pos, size_t cap, uint32_t cp)
+{
+    char buf[4];
+    size_t n;
+    if (cp < 0x80) {
+        buf[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        buf[0] = (char)(0xC0 | (cp >> 6));
+        buf[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        buf[0] = (char)(0xE0 | (cp >> 12));
+        buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        buf[0] = (char)(0xF0 | (cp >> 18));
+        buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        buf[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    for (size_t i = 0; i < n && pos < cap; i++) dst[pos++] = buf[i];
+    return pos;
+}
+
+// Parse a string starting at its opening quote. With dst, its unescaped
+// text (at most cap bytes, the rest is dropped) goes there and *len gets the
+// stored length; without, it is only checked and skipped.
+static bool parse_string(parser_t *ps, char *dst, size_t cap, size_t *len)
+{
+    size_t pos = 0;
+    ps->p++;
+    while (ps->p < ps->end) {
+        char c = *ps->p++;
+        if (c == '"') {
+            if (len) *len = pos;
+            return true;
+        }
+        if (c != '\\') {
+            if (dst && pos < cap) dst[pos++] = c;
+            continue;
+        }
+        if (ps->p >= ps->end) return false;
+        c = *ps->p++;
+        uint32_t cp;
+        switch (c) {
+            case '"': case '\\': case '/': cp = (uint32_t)c; break;
+            case 'b': cp = '\b'; break;
+            case 'f': cp = '\f'; break;
+            case 'n': cp = '\n'; break;
+            case 'r': cp = '\r'; break;
+            case 't': cp = '\t'; break;
+            case 'u': {
+                if (!read_hex4(ps, &cp)) return false;
+                uint32_t low;
+                // Surrogate pair for a code point beyond the BMP
+                if (cp >= 0xD800 && cp < 0xDC00 && ps->end - ps->p >= 6 && ps->p[0] == '\\' && ps->p[1] == 'u') {
+                    ps->p += 2;
+                    if (!read_hex4(ps, &low)) return false;
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (dst) {
+                        pos = put_utf8(dst, pos, cap, cp);
+                        cp = low;
+                    }
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+        if (dst) pos = put_utf8(dst, pos, cap, cp);
+    }
+    return false;
+}
+
+static bool parse_literal(parser_t *ps, const char *word)
+{
+    size_t n = strlen(word);
+    if ((size_t)(ps->end - ps->p) < n || memcmp(ps->p, word, n) != 0) return false;
+    ps->p += n;
+    return true;
+}
+
+static bool parse_number(parser_t *ps)
+{
+    const char *start = ps->p;
+    if (ps->p < ps->end && *ps->p == '-') ps->p++;
+    bool digits = false;
+    while (ps->p < ps->end) {
+        char c = *ps->p;
+        if (c >= '0' && c <= '9') {
+            digits = true;
+        } else if (c != '.' && c != 'e' && c != 'E' && c != '+' && c != '-') {
+            break;
+        }
+        ps->p++;
+    }
+    return digits && ps->p > start;
+}
+
+static bool parse_value(parser_t *ps);
+
+static bool push(parser_t *ps, const char *key, size_t key_len, int index)
+{
+    if (ps->depth >= JSON_EXTRACT_MAX_DEPTH) return false;
+    ps->path[ps->depth].key = key;
+    ps->path[ps->depth].key_len = key_len;
+    ps->path[ps->depth].index = index;
+    ps->depth++;
+    return true;
+}
+
+static bool parse_object(parser_t *ps)
+{
+    ps->p++;
+    skip_ws(ps);
+    if (ps->p < ps->end && *ps->p == '}') {
+        ps->p++;
+        return true;
+    }
+    for (;;) {
+        skip_ws(ps);
+        if (ps->p >= ps->end || *ps->p != '"') return false;
+        const char *key = ps->p + 1;
+        if (!parse_string(ps, NULL, 0, NULL)) return false;
+        size_t key_len = (size_t)(ps->p - 1 - key);
+        skip_ws(ps);
+        if (ps->p >= ps->end || *ps->p++ != ':') return false;
+
+        if (!push(ps, key, key_len, 0)) return false;
+        bool ok = parse_value(ps);
+        ps->depth--;
+        if (!ok) return false;
+
+        skip_ws(ps);
+        if (ps->p >= ps->end) return false;
+        char c = *ps->p++;
+        if (c == '}') return true;
+        if (c != ',') return false;
+    }
+}
+
+static bool parse_array(parser_t *ps)
+{
+    ps->p++;
+    if (!push(ps, NULL, 0, 0)) return false;
+    skip_ws(ps);
+    bool ok = true;
+    if (ps->p < ps->end && *ps->p == ']') {
+        ps->p++;
+    } else {
+        for (;;) {
+            if (!parse_value(ps)) {
+                ok = false;
+                break;
+            }
+            skip_ws(ps);
+            char c = ps->p < ps->end ? *ps->p++ : '\0';
+            if (c == ']') {
+                ps->path[ps->depth - 1].index++;
+                break;
+            }
+            if (c != ',') {
+                ok = false;
+                break;
+            }
+            ps->path[ps->depth - 1].index++;
+        }
+    }
+    if (ok) store_count(ps, ps->path[ps->depth - 1].index);
+    ps->depth--;
+    return ok;
+}
+
+static bool parse_value(parser_t *ps)
+{
+    skip_ws(ps);
+    if (ps->p >= ps->end) return false;
+    switch (*ps->p) {
+        case '{':
+            return parse_object(ps);
+        case '[':
+            return parse_array(ps);
+        case '"': {
+            uint32_t mask = text_fields_here(ps, true);
+            if (!mask) return parse_string(ps, NULL, 0, NULL);
+            char buf[JSON_EXTRACT_MAX_STRING];
+            size_t len;
+            if (!parse_string(ps, buf, sizeof(buf), &len)) return false;
+            store_string(ps, mask, buf, len);
+            return true;
+        }
+        case 'n':
+            return parse_literal(ps, "null");
+        default: {
+            const char *start = ps->p;
+            bool ok = *start == 't' ? parse_literal(ps, "true") :
+                      *start == 'f' ? parse_literal(ps, "false") : parse_number(ps);
+            // Numbers and booleans are kept as the text they were sent as
+            uint32_t mask = ok ? text_fields_here(ps, false) : 0;
+            if (mask) store_string(ps, mask, start, (size_t)(ps->p - start));
+            return ok;
+        }
+    }
+}
+
+// Binary payloads (CBOR, MessagePack). Strings are stored as they are,
+// numbers and booleans as the text JSON would carry for them. Numbers are
+// turned into text here, not at render time, because the widget store holds
+// display text for every encoding; only values a field matches are
+// formatted, and tools/bench/bench_payload measures what that costs.
+
+// Key a value is walked under when its map key is not a text string, and the
+// key itself too: no path step matches it
+static const char no_key[] = "";
+
+static bool read_be(parser_t *ps, int n, uint64_t *out)
+{
+    if (ps->end - ps->p < n) return false;
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) {
+        v = (v << 8) | (uint8_t)ps->p[i];
+    }
+    ps->p += n;
+    *out = v;
+    return true;
+}
+
+// Numbers are only turned into text when a field wants them, and without
+// printf: it costs more than decoding the whole payload.
+
+static void store_scalar(parser_t *ps, const char *text)
+{
+    uint32_t mask = text_fields_here(ps, false);
+    if (mask) store_string(ps, mask, text, strlen(text));
+}
+
+// Digits of v, right-aligned to end; returns where they start
+static char *format_u64(char *end, uint64_t v)
+{
+    char *p = end;
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    return p;
+}
+
+static void store_integer(parser_t *ps, uint64_t magnitude, bool negative)
+{
+    uint32_t mask = text_fields_here(ps, false);
+    if (!mask) return;
+    char buf[24];
+    char *p = format_u64(buf + sizeof(buf), magnitude);
+    if (negative) *--p = '-';
+    store_string(ps, mask, p, (size_t)(buf + sizeof(buf) - p));
+}
+
+static void store_unsigned(parser_t *ps, uint64_t v)
+{
+    store_integer(ps, v, false);
+}
+
+// The value -1 - v, how CBOR encodes negative integers
+static void store_negative(parser_t *ps, uint64_t v)
+{
+    if (v == UINT64_MAX) {
+        store_scalar(ps, "-18446744073709551616");
+    } else {
+        store_integer(ps, v + 1, true);
+    }
+}
+
+#define FLOAT_MAX_DECIMALS 9
+
+static const double pow10_table[FLOAT_MAX_DECIMALS + 1] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+};
+
+// The shortest decimal that reads back as v, so 21.4 sent as a float gives
+// "21.4" and not "21.3999996". is_float: v came from a 32-bit float.
+static void store_float(parser_t *ps, double v, bool is_float)
+{
+    uint32_t mask = text_fields_here(ps, false);
+    if (!mask || !isfinite(v)) return;
+
+    char buf[32];
+    double magnitude = fabs(v);
+    for (int decimals = 0; decimals <= FLOAT_MAX_DECIMALS && magnitude < 1e15 / pow10_table[decimals]; decimals++) {
+        double scaled = nearbyint(magnitude * pow10_table[decimals]);
+        double back = scaled / pow10_table[decimals];
+        if (is_float ? (float)back != (float)magnitude : back != magnitude) continue;
+
+        uint64_t digits = (uint64_t)scaled;
+        char *end = buf + sizeof(buf);
+        char *p = end;
+        if (decimals > 0) {
+            uint64_t fraction = digits % (uint64_t)pow10_table[decimals];
+            for (int i = 0; i < decimals; i++, fraction /= 10) {
+                *--p = (char)('0' + fraction % 10);
+            }
+            *--p = '.';
+        }
+        p = format_u64(p, digits / (uint64_t)pow10_table[decimals]);
+        if (v < 0 && digits != 0) *--p = '-';
+        store_string(ps, mask, p, (size_t)(end - p));
+        return;
+    }
+    // Very large or very small: exponent notation
+    snprintf(buf, sizeof(buf), "%.*g", is_float ? 9 : 17, v);
+    store_string(ps, mask, buf, strlen(buf));
+}
+
+static double half_to_double(uint16_t h)
+{
+    int exponent = (h >> 10) & 0x1f;
+    double mantissa = h & 0x3ff;
+    double v;
+    if (exponent == 0) {
+        v = ldexp(mantissa, -24);
+    } else if (exponent == 31) {
+        v = mantissa == 0 ? INFINITY : NAN;
+    } else {
+        v = ldexp(mantissa + 1024, exponent - 25);
+    }
+    return (h & 0x8000) ? -v : v;
+}
+
+static double float_bits(uint64_t bits, int n)
+{
+    if (n == 4) {
+        uint32_t b = (uint32_t)bits;
+        float f;
+        memcpy(&f, &b, sizeof(f));
+        return f;
+    }
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+// A string value of len bytes at the current position
+static bool binary_string(parser_t *ps, uint64_t len, bool text)
+{
+    if (len > (uint64_t)(ps->end - ps->p)) return false;
+    uint32_t mask = text ? text_fields_here(ps, true) : 0;
+    if (mask) store_string(ps, mask, ps->p, (size_t)len);
+    ps->p += len;
+    return true;
+}
+
+// CBOR (RFC 8949)
+
+#define CBOR_BREAK 0xff
+
+static bool cbor_item(parser_t *ps);
+
+// Head of an item: major type and argument, *indefinite for length 31
+static bool cbor_head(parser_t *ps, int *major, int *info, uint64_t *arg, bool *indefinite)
+{
+    if (ps->p >= ps->end) return false;
+    uint8_t b = (uint8_t)*ps->p++;
+    *major = b >> 5;
+    *info = b & 0x1f;
+    *indefinite = false;
+    *arg = 0;
+    if (*info < 24) {
+        *arg = (uint64_t)*info;
+        return true;
+    }
+    if (*info == 31) {
+        *indefinite = true;
+        return *major >= 2 && *major <= 5;
+    }
+    if (*info > 27) return false;
+    return read_be(ps, 1 << (*info - 24), arg);
+}
+
+// Head of the next item past any tags, which are dropped. Skipped in a loop:
+// a tag is a single byte, so recursing per tag would let a payload of
+// chained tags run the stack out.
+static bool cbor_item_head(parser_t *ps, int *major, int *info, uint64_t *arg, bool *indefinite)
+{
+    do {
+        if (!cbor_head(ps, major, info, arg, indefinite)) return false;
+    } while (*major == 6);
+    return true;
+}
+
+static bool cbor_at_break(parser_t *ps)
+{
+    if (ps->p < ps->end && (uint8_t)*ps->p == CBOR_BREAK) {
+        ps->p++;
+        return true;
+    }
+    return false;
+}
+
+// Indefinite-length string: definite chunks of the same major type up to a break
+static bool cbor_chunked_string(parser_t *ps, int major)
+{
+    uint32_t mask = major == 3 ? text_fields_here(ps, true) : 0;
+    char buf[JSON_EXTRACT_MAX_STRING];
+    size_t len = 0;
+    while (!cbor_at_break(ps)) {
+        int chunk_major, info;
+        uint64_t n;
+        bool indefinite;
+        if (!cbor_head(ps, &chunk_major, &info, &n, &indefinite) || chunk_major != major || indefinite ||
+            n > (uint64_t)(ps->end - ps->p)) {
+            return false;
+        }
+        size_t take = n < sizeof(buf) - len ? (size_t)n : sizeof(buf) - len;
+        memcpy(buf + len, ps->p, take);
+        len += take;
+        ps->p += n;
+    }
+    if (mask) store_string(ps, mask, buf, len);
+    return true;
+}
+
+static bool cbor_array(parser_t *ps, uint64_t n, bool indefinite)
+{
+    // Every item takes at least a byte
+    if (!indefinite && n > (uint64_t)(ps->end - ps->p)) return false;
+    if (!push(ps, NULL, 0, 0)) return false;
+    path_entry_t *e = &ps->path[ps->depth - 1];
+    bool ok = true;
+    for (uint64_t i = 0; indefinite || i < n; i++) {
+        if (indefinite && cbor_at_break(ps)) break;
+        if (!cbor_item(ps)) {
+            ok = false;
+            break;
+        }
+        e->index++;
+    }
+    if (ok) store_count(ps, e->index);
+    ps->depth--;
+    return ok;
+}
+
+static bool cbor_map(parser_t *ps, uint64_t n, bool indefinite)
+{
+    if (!indefinite && n > (uint64_t)(ps->end - ps->p) / 2) return false;
+    for (uint64_t i = 0; indefinite || i < n; i++) {
+        if (indefinite && cbor_at_break(ps)) break;
+        const char *key = no_key;
+        size_t key_len = 0;
+        // Text keys are matched; anything else is skipped
+        if (ps->p < ps->end && ((uint8_t)*ps->p >> 5) == 3 && ((uint8_t)*ps->p & 0x1f) != 31) {
+            int major, info;
+            uint64_t len;
+            bool unused;
+            if (!cbor_head(ps, &major, &info, &len, &unused) || len > (uint64_t)(ps->end - ps->p)) return false;
+            key = ps->p;
+            key_len = (size_t)len;
+            ps->p += len;
+        } else {
+            // Walked under the empty key, so nothing in it matches
+            if (!push(ps, no_key, 0, 0)) return false;
+            bool ok = cbor_item(ps);
+            ps->depth--;
+            if (!ok) return false;
+        }
+        if (!push(ps, key, key_len, 0)) return false;
+        bool ok = cbor_item(ps);
+        ps->depth--;
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static bool cbor_item(parser_t *ps)
+{
+    int major, info;
+    uint64_t arg;
+    bool indefinite;
+    if (!cbor_item_head(ps, &major, &info, &arg, &indefinite)) return false;
+    switch (major) {
+        case 0:
+            store_unsigned(ps, arg);
+            return true;
+        case 1:
+            store_negative(ps, arg);
+            return true;
+        case 2:
+        case 3:
+            return indefinite ? cbor_chunked_string(ps, major) : binary_string(ps, arg, major == 3);
+        case 4:
+            return cbor_array(ps, arg, indefinite);
+        case 5:
+            return cbor_map(ps, arg, indefinite);
+        default:
+            switch (info) {
+                case 20: store_scalar(ps, "false"); break;
+                case 21: store_scalar(ps, "true"); break;
+                case 25: store_float(ps, half_to_double((uint16_t)arg), true); break;
+                case 26: store_float(ps, float_bits(arg, 4), true); break;
+                case 27: store_float(ps, float_bits(arg, 8), false); break;
+                default: break;  // null, undefined and other simple values
+            }
+            return true;
+    }
+}
+
+// MessagePack
+
+static bool msgpack_item(parser_t *ps);
+
+static bool msgpack_array(parser_t *ps, uint64_t n)
+{
+    if (n > (uint64_t)(ps->end - ps->p)) return false;
+    if (!push(ps, NULL, 0, 0)) return false;
+    path_entry_t *e = &ps->path[ps->depth - 1];
+    bool ok = true;
+    for (uint64_t i = 0; i < n; i++) {
+        if (!msgpack_item(ps)) {
+            ok = false;
+            break;
+        }
+        e->index++;
+    }
+    if (ok) store_count(ps, e->index);
+    ps->depth--;
+    return ok;
+}
+
+static bool msgpack_map(parser_t *ps, uint64_t n)
+{
+    if (n > (uint64_t)(ps->end - ps->p) / 2) return false;
+    for (uint64_t i = 0; i < n; i++) {
+        const char *key = no_key;
+        size_t key_len = 0;
+        uint8_t b = ps->p < ps->end ? (uint8_t)*ps->p : 0;
+        uint64_t len;
+        if ((b & 0xe0) == 0xa0 || (b >= 0xd9 && b <= 0xdb)) {
+            ps->p++;
+            if ((b & 0xe0) == 0xa0) {
+                len = b & 0x1f;
+            } else if (!read_be(ps, 1 << (b - 0xd9), &len)) {
+                return false;
+            }
+            if (len > (uint64_t)(ps->end - ps->p)) return false;
+            key = ps->p;
+            key_len = (size_t)len;
+            ps->p += len;
+        } else {
+            // Walked under the empty key, so nothing in it matches
+            if (!push(ps, no_key, 0, 0)) return false;
+            bool ok = msgpack_item(ps);
+            ps->depth--;
+            if (!ok) return false;
+        }
+        if (!push(ps, key, key_len, 0)) return false;
+        bool ok = msgpack_item(ps);
+        ps->depth--;
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static bool msgpack_item(parser_t *ps)
+{
+    if (ps->p >= ps->end) return false;
+    uint8_t b = (uint8_t)*ps->p++;
+    uint64_t v;
+    if (b <= 0x7f) {
+        store_unsigned(ps, b);
+        return true;
+    }
+    if (b >= 0xe0) {
+        store_negative(ps, (uint64_t)(0xff - b));
+        return true;
+    }
+    if (b <= 0x8f) return msgpack_map(ps, b & 0x0f);
+    if (b <= 0x9f) return msgpack_array(ps, b & 0x0f);
+    if (b <= 0xbf) return binary_string(ps, b & 0x1f, true);
+
+    switch (b) {
+        case 0xc0:
+            return true;
+        case 0xc2:
+            store_scalar(ps, "false");
+            return true;
+        case 0xc3:
+            store_scalar(ps, "true");
+            return true;
+        case 0xc4: case 0xc5: case 0xc6:
+            return read_be(ps, 1 << (b - 0xc4), &v) && binary_string(ps, v, false);
+        case 0xc7: case 0xc8: case 0xc9:
+            // ext: length, type byte, data
+            return read_be(ps, 1 << (b - 0xc7), &v) && v < (uint64_t)(ps->end - ps->p) && binary_string(ps, v + 1, false);
+        case 0xca:
+            if (!read_be(ps, 4, &v)) return false;
+            store_float(ps, float_bits(v, 4), true);
+            return true;
+        case 0xcb:
+            if (!read_be(ps, 8, &v)) return false;
+            store_float(ps, float_bits(v, 8), false);
+            return true;
+        case 0xcc: case 0xcd: case 0xce: case 0xcf:
+            if (!read_be(ps, 1 << (b - 0xcc), &v)) return false;
+            store_unsigned(ps, v);
+            return true;
+        case 0xd0: case 0xd1: case 0xd2: case 0xd3: {
+            int n = 1 << (b - 0xd0);
+            if (!read_be(ps, n, &v)) return false;
+            // Sign-extend from n bytes
+            int64_t s = n == 8 ? (int64_t)v : (int64_t)(v << (64 - 8 * n)) >> (64 - 8 * n);
+            if (s < 0) {
+                store_negative(ps, (uint64_t)(-(s + 1)));
+            } else {
+                store_unsigned(ps, (uint64_t)s);
+            }
+            return true;
+        }
+        case 0xd4: case 0xd5: case 0xd6: case 0xd7: case 0xd8:
+            // fixext: type byte and 1..16 bytes of data
+            return binary_string(ps, 1 + (1u << (b - 0xd4)), false);
+        case 0xd9: case 0xda: case 0xdb:
+            return read_be(ps, 1 << (b - 0xd9), &v) && binary_string(ps, v, true);
+        case 0xdc: case 0xdd:
+            return read_be(ps, 2 << (b - 0xdc), &v) && msgpack_array(ps, v);
+        case 0xde: case 0xdf:
+            return read_be(ps, 2 << (b - 0xde), &v) && msgpack_map(ps, v);
+        default:
+            return false;
+    }
+}
+
+void json_program_init(json_program_t *program)
+{
+    memset(program, 0, sizeof(*program));
+}
+
+// Steps of one path, appended after the program's used steps. Returns the
+// number of steps, -1 if the path is malformed or does not fit.
+static int compile_path(json_program_t *program, const char *p)
+{
+    int n = program->used_steps;
+    // "$" is the document itself, "$.a" and "$[0]" continue from it
+    if (*p == '$') {
+        p++;
+        if (*p == '.') {
+            p++;
+            if (*p == '\0' || *p == '.' || *p == '[') return -1;
+        } else if (*p && *p != '[') {
+            return -1;
+        }
+    }
+    while (*p) {
+        if (n >= JSON_PROGRAM_MAX_STEPS || n - program->used_steps >= JSON_EXTRACT_MAX_DEPTH) return -1;
+        json_step_t *step = &program->steps[n++];
+        if (*p == '[') {
+            p++;
+            step->key = NULL;
+            step->key_len = 0;
+            step->index = -1;
+            if (*p == '*') {
+                p++;
+            } else if (*p >= '0' && *p <= '9') {
+                char *end;
+                long index = strtol(p, &end, 10);
+                if (index > INT16_MAX) return -1;
+                step->index = (int16_t)index;
+                p = end;
+            }
+            if (*p++ != ']') return -1;
+            if (*p && *p != '.' && *p != '[') return -1;
+        } else {
+            size_t key_len = strcspn(p, ".[");
+            if (key_len == 0 || key_len > UINT16_MAX) return -1;
+            step->key = p;
+            step->key_len = (uint16_t)key_len;
+            step->index = 0;
+            p += key_len;
+        }
+        if (*p == '.') {
+            p++;
+            if (*p == '\0' || *p == '.' || *p == '[') return -1;
+        }
+    }
+    return n - program->used_steps;
+}
+
+bool json_program_add(json_program_t *program, const json_field_t *field)
+{
+    if (program->num_fields >= JSON_PROGRAM_MAX_FIELDS) return false;
+    int n = compile_path(program, field->path);
+    if (n < 0) return false;
+
+    int i = program->num_fields++;
+    program->fields[i] = *field;
+    program->first_step[i] = program->used_steps;
+    program->num_steps[i] = (uint8_t)n;
+    program->used_steps += (uint8_t)n;
+    if (n > program->max_depth) program->max_depth = (uint8_t)n;
+    return true;
+}
+
+static void parser_init(parser_t *ps, const char *data, size_t len, const json_program_t *program, void *out)
+{
+    ps->p = data;
+    ps->end = data + len;
+    ps->program = program;
+    ps->out = (uint8_t *)out;
+    ps->changed = 0;
+    ps->counted = 0;
+    ps->depth = 0;
+}
+
+static void parser_finish(parser_t *ps, uint32_t *changed)
+{
+    // An array that is missing counts as empty
+    const json_program_t *program = ps->program;
+    for (int i = 0; i < program->num_fields; i++) {
+        if (program->fields[i].kind == JSON_FIELD_COUNT && !(ps->counted & (1u << i))) {
+            int *dst = (int *)(ps->out + program->fields[i].offset);
+            if (*dst != 0) ps->changed |= 1u << i;
+            *dst = 0;
+        }
+    }
+    *changed = ps->changed;
+}
+
+bool json_extract(const char *json, size_t len, const json_program_t *program, void *out, uint32_t *changed)
+{
+    parser_t ps;
+    parser_init(&ps, json, len, program, out);
+    if (!parse_value(&ps)) {
+        return false;
+    }
+    // Trailing whitespace, or the NUL some publishers send along
+    skip_ws(&ps);
+    if (ps.p < ps.end && *ps.p != '\0') {
+        return false;
+    }
+    parser_finish(&ps, changed);
+    return true;
+}
+
+// Nothing matches it: the walkers only check syntax
+static const json_program_t empty_program;
+
+static bool add_member(payload_member_t *members, int max, int *n, const char *key, size_t key_len,
+                       uint64_t index, const char *value, const char *value_end)
+{
+    if (*n == max) return false;
+    members[(*n)++] = (payload_member_t){
+        .key = key,
+        .key_len = key_len,
+        .index = key || index > INT_MAX ? -1 : (int)index,
+        .value = value,
+        .value_len = (size_t)(value_end - value),
+    };
+    return true;
+}
+
+static int json_split(parser_t *ps, payload_member_t *members, int max)
+{
+    skip_ws(ps);
+    if (ps->p >= ps->end || *ps->p != '{') return -1;
+    ps->p++;
+    skip_ws(ps);
+    int n = 0;
+    if (ps->p < ps->end && *ps->p == '}') {
+        ps->p++;
+    } else {
+        for (;;) {
+            skip_ws(ps);
+            if (ps->p >= ps->end || *ps->p != '"') return -1;
+            const char *key = ps->p + 1;
+            if (!parse_string(ps, NULL, 0, NULL)) return -1;
+            size_t key_len = (size_t)(ps->p - 1 - key);
+            skip_ws(ps);
+            if (ps->p >= ps->end || *ps->p++ != ':') return -1;
+            skip_ws(ps);
+            const char *value = ps->p;
+            if (!parse_value(ps)) return -1;
+            if (!add_member(members, max, &n, key, key_len, 0, value, ps->p)) return -1;
+
+            skip_ws(ps);
+            if (ps->p >= ps->end) return -1;
+            char c = *ps->p++;
+            if (c == '}') break;
+            if (c != ',') return -1;
+        }
+    }
+    skip_ws(ps);
+    return ps->p < ps->end && *ps->p != '\0' ? -1 : n;
+}
+
+static int cbor_split(parser_t *ps, payload_member_t *members, int max)
+{
+    int major, info;
+    uint64_t count;
+    bool indefinite;
+    if (!cbor_item_head(ps, &major, &info, &count, &indefinite) || major != 5) return -1;
+    if (!indefinite && count > (uint64_t)(ps->end - ps->p) / 2) return -1;
+    int n = 0;
+    for (uint64_t i = 0; indefinite || i < count; i++) {
+        if (indefinite && cbor_at_break(ps)) break;
+        const char *key = NULL;
+        uint64_t key_arg = 0;
+        bool keep = false;
+        uint8_t b = ps->p < ps->end ? (uint8_t)*ps->p : 0;
+        int key_major = b >> 5;
+        if ((key_major == 0 || key_major == 3) && (b & 0x1f) != 31) {
+            // Unsigned integer or definite text
+            bool unused;
+            if (!cbor_head(ps, &major, &info, &key_arg, &unused)) return -1;
+            if (major == 3) {
+                if (key_arg > (uint64_t)(ps->end - ps->p)) return -1;
+                key = ps->p;
+                ps->p += key_arg;
+            }
+            keep = true;
+        } else if (!cbor_item(ps)) {
+            return -1;
+        }
+        const char *value = ps->p;
+        if (!cbor_item(ps)) return -1;
+        if (keep && !add_member(members, max, &n, key, key ? (size_t)key_arg : 0, key_arg, value, ps->p)) return -1;
+    }
+    return ps->p == ps->end ? n : -1;
+}
+
+static int msgpack_split(parser_t *ps, payload_member_t *members, int max)
+{
+    if (ps->p >= ps->end) return -1;
+    uint8_t b = (uint8_t)*ps->p++;
+    uint64_t count;
+    if ((b & 0xf0) == 0x80) {
+        count = b & 0x0f;
+    } else if (b == 0xde || b == 0xdf) {
+        if (!read_be(ps, 2 << (b - 0xde), &count)) return -1;
+    } else {
+        return -1;
+    }
+    if (count > (uint64_t)(ps->end - ps->p) / 2) return -1;
+    int n = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        const char *key = NULL;
+        uint64_t key_arg = 0;
+        bool keep = true;
+        b = ps->p < ps->end ? (uint8_t)*ps->p : 0;
+        if ((b & 0xe0) == 0xa0 || (b >= 0xd9 && b <= 0xdb)) {
+            ps->p++;
+            if ((b & 0xe0) == 0xa0) {
+                key_arg = b & 0x1f;
+            } else if (!read_be(ps, 1 << (b - 0xd9), &key_arg)) {
+                return -1;
+            }
+            if (key_arg > (uint64_t)(ps->end - ps->p)) return -1;
+            key = ps->p;
+            ps->p += key_arg;
+        } else if (b <= 0x7f && ps->p < ps->end) {
+            key_arg = b;
+            ps->p++;
+        } else if (b >= 0xcc && b <= 0xcf) {
+            ps->p++;
+            if (!read_be(ps, 1 << (b - 0xcc), &key_arg)) return -1;
+        } else if (!msgpack_item(ps)) {
+            return -1;
+        } else {
+            keep = false;
+        }
+        const char *value = ps->p;
+        if (!msgpack_item(ps)) return -1;
+        if (keep && !add_member(members, max, &n, key, key ? (size_t)key_arg : 0, key_arg, value, ps->p)) return -1;
+    }
+    return ps->p == ps->end ? n : -1;
+}
+
+int payload_split(payload_encoding_t encoding, const char *data, size_t len, payload_member_t *members, int max)
+{
+    parser_t ps;
+    parser_init(&ps, data, len, &empty_program, NULL);
+    switch (encoding) {
+        case PAYLOAD_CBOR:
+            return cbor_split(&ps, members, max);
+        case PAYLOAD_MSGPACK:
+            return msgpack_split(&ps, members, max);
+        default:
+            return json_split(&ps, members, max);
+    }
+}
+
+bool payload_extract(payload_encoding_t encoding, const char *data, size_t len, const json_program_t *program,
+                     void *out, uint32_t *changed)
+{
+    if (encoding == PAYLOAD_JSON) {
+        return json_extract(data, len, program, out, changed);
+    }
+    parser_t ps;
+    parser_init(&ps, data, len, program, out);
+    bool ok = encoding == PAYLOAD_CBOR ? cbor_item(&ps) : msgpack_item(&ps);
+    if (!ok || ps.p != ps.end) {
+        return false;
+    }
+    parser_finish(&ps, changed);
+    return true;
+}
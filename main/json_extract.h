@@ -0,0 +1,103 @@
+#ifndef JSON_EXTRACT_H
+#define JSON_EXTRACT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Single-pass payload field extractor for JSON, CBOR and MessagePack. Walks
+// a payload without building a tree or touching the heap and copies the
+// values at the configured paths straight into a fixed-layout struct,
+// noting which targets changed.
+//
+// Paths are object keys separated by '.', optionally after a leading "$",
+// with "[n]" selecting one element of an array and "[]" (or "[*]") every
+// element: "value", "items[].label", "$.ENERGY.Power", "$.sensors[1].t".
+// Keys match case-insensitively like cJSON_GetObjectItem; if a key repeats,
+// the last occurrence wins. Fields are compiled into a json_program_t once,
+// so a payload pass only compares keys.
+
+#define JSON_EXTRACT_MAX_DEPTH  16
+#define JSON_EXTRACT_MAX_STRING 128
+#define JSON_PROGRAM_MAX_FIELDS 4
+#define JSON_PROGRAM_MAX_STEPS  16
+
+typedef enum {
+    PAYLOAD_JSON,
+    PAYLOAD_CBOR,
+    PAYLOAD_MSGPACK,
+} payload_encoding_t;
+
+typedef enum {
+    JSON_FIELD_STRING,  // string value into char[size], NUL-padded; other values are ignored
+    JSON_FIELD_SCALAR,  // like STRING, but numbers and booleans are stored as their text
+    JSON_FIELD_COUNT,   // element count of the array at path ("items[]") into an int, 0 if absent
+} json_field_kind_t;
+
+typedef struct {
+    const char *path;
+    json_field_kind_t kind;
+    size_t offset;      // of the target in the output struct
+    size_t size;        // of a string target, at most JSON_EXTRACT_MAX_STRING
+    size_t stride;      // between the targets of consecutive "[]" elements
+    int max_items;      // "[]" elements past this are skipped, counts are capped to it
+} json_field_t;
+
+// One level of a compiled path
+typedef struct {
+    const char *key;    // member name (points into the path), NULL for an array step
+    uint16_t key_len;
+    int16_t index;      // array step: element index, -1 for every element
+} json_step_t;
+
+typedef struct {
+    json_field_t fields[JSON_PROGRAM_MAX_FIELDS];
+    uint8_t first_step[JSON_PROGRAM_MAX_FIELDS];
+    uint8_t num_steps[JSON_PROGRAM_MAX_FIELDS];
+    json_step_t steps[JSON_PROGRAM_MAX_STEPS];
+    uint8_t num_fields;
+    uint8_t used_steps;
+    uint8_t max_depth;  // deepest path; nothing below it is matched
+} json_program_t;
+
+void json_program_init(json_program_t *program);
+// Compile field (its path must outlive the program) as the next field.
+// False if the path is malformed or the program is full.
+bool json_program_add(json_program_t *program, const json_field_t *field);
+
+// Extract the program's fields from json (len bytes, need not be
+// NUL-terminated) into out. Bit i of *changed is set if field i's target now
+// holds something else. Returns false on malformed JSON; out may then be
+// partly written.
+bool json_extract(const char *json, size_t len, const json_program_t *program, void *out, uint32_t *changed);
+
+// The same for a payload in any of the encodings. Binary numbers and
+// booleans are stored as the text JSON would carry for them.
+bool payload_extract(payload_encoding_t encoding, const char *data, size_t len, const json_program_t *program,
+                     void *out, uint32_t *changed);
+
+// One member of a payload's top-level object, its value a complete payload
+// of the same encoding
+typedef struct {
+    const char *key;    // raw key text, NULL if the key is an integer
+    size_t key_len;
+    int index;          // an unsigned integer key, -1 for a text key
+    const char *value;
+    size_t value_len;
+} payload_member_t;
+
+// Split a payload whose top level is an object (map) into its members,
+// checking the whole payload first. Members with keys of other types are
+// left out. Returns the member count, or -1 if the payload is malformed, not
+// an object, or has more than max members.
+int payload_split(payload_encoding_t encoding, const char *data, size_t len, payload_member_t *members, int max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_EXTRACT_H
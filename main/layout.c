@@ -0,0 +1,99 @@
+#include "layout.h"
+#include "epd_driver.h"
+#include "esp_log.h"
+#include <stdlib.h>
+
+static const char *TAG = "LAYOUT";
+static layout_t layout;
+
+// Column edges distribute the fractional column width exactly (800 / 12 =
+// 66.67px), then move to the nearest multiple of 8 when that stays close
+// and keeps the edges strictly increasing.
+static void layout_column_edges(int16_t *edges)
+{
+    for (int i = 0; i <= LAYOUT_GRID_COLS; i++) {
+        int exact = (i * EPD_WIDTH + LAYOUT_GRID_COLS / 2) / LAYOUT_GRID_COLS;
+        int snapped = (exact + 4) & ~7;
+        int prev = i > 0 ? edges[i - 1] : -1;
+        int delta = snapped > exact ? snapped - exact : exact - snapped;
+        edges[i] = (int16_t)((delta <= LAYOUT_SNAP_MAX && snapped > prev && snapped <= EPD_WIDTH) ? snapped : exact);
+    }
+}
+
+static void layout_row_edges(int16_t *edges)
+{
+    for (int i = 0; i <= LAYOUT_GRID_ROWS; i++) {
+        edges[i] = (int16_t)((i * EPD_HEIGHT + LAYOUT_GRID_ROWS / 2) / LAYOUT_GRID_ROWS);
+    }
+}
+
+static int clamp(int v, int lo, int hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Widget's grid span clamped to the grid: x0, y0, x1, y1 (exclusive)
+static void layout_span(const widget_config_t *widget, int span[4])
+{
+    span[0] = clamp(widget->position.x, 0, LAYOUT_GRID_COLS - 1);
+    span[1] = clamp(widget->position.y, 0, LAYOUT_GRID_ROWS - 1);
+    span[2] = clamp(span[0] + (widget->size.width > 0 ? widget->size.width : 1), span[0] + 1, LAYOUT_GRID_COLS);
+    span[3] = clamp(span[1] + (widget->size.height > 0 ? widget->size.height : 1), span[1] + 1, LAYOUT_GRID_ROWS);
+}
+
+bool layout_build(const app_config_t *config)
+{
+    int16_t cols[LAYOUT_GRID_COLS + 1];
+    int16_t rows[LAYOUT_GRID_ROWS + 1];
+    layout_column_edges(cols);
+    layout_row_edges(rows);
+
+    free(layout.cells);
+    layout.cells = NULL;
+    layout.count = 0;
+    layout.overlaps = 0;
+    if (config->num_widgets == 0) {
+        return true;
+    }
+
+    layout.cells = (layout_rect_t *)calloc((size_t)config->num_widgets, sizeof(layout_rect_t));
+    if (!layout.cells) {
+        ESP_LOGE(TAG, "Failed to allocate layout for %d widgets", config->num_widgets);
+        return false;
+    }
+
+    for (int i = 0; i < config->num_widgets; i++) {
+        const widget_config_t *widget = &config->widgets[i];
+        int s[4];
+        layout_span(widget, s);
+        if (s[0] != widget->position.x || s[1] != widget->position.y ||
+            s[2] - s[0] != widget->size.width || s[3] - s[1] != widget->size.height) {
+            ESP_LOGW(TAG, "Widget %s clamped to grid: (%d,%d) %dx%d", widget->name, s[0], s[1], s[2] - s[0], s[3] - s[1]);
+        }
+
+        layout_rect_t *cell = &layout.cells[i];
+        cell->x = cols[s[0]];
+        cell->y = rows[s[1]];
+        cell->w = (int16_t)(cols[s[2]] - cols[s[0]]);
+        cell->h = (int16_t)(rows[s[3]] - rows[s[1]]);
+
+        for (int j = 0; j < i; j++) {
+            if (config->widgets[j].page != widget->page) continue;
+            int o[4];
+            layout_span(&config->widgets[j], o);
+            if (s[0] < o[2] && o[0] < s[2] && s[1] < o[3] && o[1] < s[3]) {
+                ESP_LOGW(TAG, "Widgets %s and %s overlap", config->widgets[j].name, widget->name);
+                layout.overlaps++;
+            }
+        }
+    }
+
+    layout.count = config->num_widgets;
+    ESP_LOGI(TAG, "Layout built for %d widgets, %d overlaps", layout.count, layout.overlaps);
+    return true;
+}
+
+const layout_t *layout_get(void)
+{
+    return &layout;
+}
@@ -0,0 +1,54 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include "config_types.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LAYOUT_GRID_COLS 12
+#define LAYOUT_GRID_ROWS 8
+#define LAYOUT_GUTTER    8  // space between neighbouring cards
+#define LAYOUT_PADDING   5  // inset of card content from its border
+#define LAYOUT_SNAP_MAX  4  // max distance a column edge moves to hit a byte boundary
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+    int16_t w;
+    int16_t h;
+} layout_rect_t;
+
+// Pixel cells for the loaded widgets, indexed like app_config_t.widgets.
+// Cells tile the panel; their x edges sit on byte boundaries where possible
+// so they can be blitted and partially refreshed without bit shifting.
+typedef struct {
+    layout_rect_t *cells;
+    int count;
+    int overlaps;
+} layout_t;
+
+// Convert the widgets' grid positions to pixel cells. Called at config load.
+bool layout_build(const app_config_t *config);
+const layout_t *layout_get(void);
+
+// Card border inside a cell, in epd_draw_rect() terms (covers w + 1 by h + 1 pixels)
+static inline layout_rect_t layout_card_rect(layout_rect_t cell)
+{
+    layout_rect_t card = {
+        (int16_t)(cell.x + LAYOUT_GUTTER / 2),
+        (int16_t)(cell.y + LAYOUT_GUTTER / 2),
+        (int16_t)(cell.w - LAYOUT_GUTTER - 1),
+        (int16_t)(cell.h - LAYOUT_GUTTER - 1),
+    };
+    return card;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LAYOUT_H
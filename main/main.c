@@ -6,6 +6,7 @@
 #include "web_server.h"
 #include "config_parser.h"
 #include "app_mqtt.h"
+#include "button_handler.h"
 
 static const char *TAG = "MAIN";
 
@@ -13,6 +14,25 @@ void app_main(void)
 {
     ESP_LOGI(TAG, "Starting E-Ink Dashboard Application");
 
+    // Load configuration from SPIFFS
+    bool config_loaded = load_config();
+    if (!config_loaded) {
+        ESP_LOGE(TAG, "Failed to load configuration, using defaults");
+    }
+
+    // Initialize display and its render task before any MQTT data can arrive.
+    // Restores the last frame from flash, so this comes before the network.
+    display_init();
+
+    // Render widgets based on configuration
+    if (config_loaded) {
+        ESP_LOGI(TAG, "Configuration loaded successfully");
+        display_render_widgets();
+        button_handler_start();
+    } else {
+        display_default_view();
+    }
+
     // Initialize Wi-Fi and wait for connection
     if (wifi_init_sta()) {
         ESP_LOGI(TAG, "Wi-Fi connected, proceeding with application");
@@ -20,24 +40,9 @@ void app_main(void)
         // Start the web server
         start_web_server();
 
-        // Load configuration from SPIFFS
-        bool config_loaded = load_config();
+        // Start MQTT client
         if (config_loaded) {
-            ESP_LOGI(TAG, "Configuration loaded successfully");
-            // Start MQTT client
             mqtt_app_start();
-        } else {
-            ESP_LOGE(TAG, "Failed to load configuration, using defaults");
-        }
-
-        // Initialize display
-        display_init();
-
-        // Render widgets based on configuration
-        if (config_loaded) {
-            display_render_widgets();
-        } else {
-            display_default_view();
         }
     } else {
         ESP_LOGE(TAG, "Wi-Fi connection failed, stopping application");
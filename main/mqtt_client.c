@@ -1,40 +1,441 @@
 #include "app_mqtt.h"
 #include "esp_log.h"
 #include "config_parser.h"
+#include "topic_router.h"
 #include "display_manager.hpp"
+#include "update_mailbox.h"
+#include "alloc_probe.h"
 #include <stdio.h>
 #include "esp_event.h"
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <mqtt_client.h>
 #include "esp_idf_version.h"
+#include "esp_mac.h"
+#include "nvs.h"
 
 static const char *TAG = "MQTT_CLIENT";
 
+static esp_mqtt_client_handle_t mqtt_client;
+static mqtt_stats_t mqtt_stats;
+
+// Kept for the client's lifetime: it points into them, and a persistent
+// session is switched on by re-applying the config
+static esp_mqtt_client_config_t mqtt_cfg;
+static char broker_url[256];
+static char client_id[64];
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+// User property sent with CONNECT listing the payload encodings the
+// widgets decode, so publishers can pick the most compact one
+#define MQTT5_ENCODINGS_PROPERTY "payload-encodings"
+#define MQTT5_ENCODINGS "json,cbor,msgpack"
+// Headroom over payload and topic for the fixed header and properties
+#define MQTT5_PACKET_OVERHEAD 64
+#endif
+
+// Persistent sessions: the key of the subscription set is saved once a
+// session holds it, so a later boot can resume that session
+#define MQTT_NVS_NAMESPACE "mqtt"
+#define MQTT_NVS_SESSION_KEY "session"
+static bool persistent_session;
+static bool clean_session_off;
+static uint32_t session_key;
+
+// Messages larger than the client's receive buffer arrive as consecutive
+// MQTT_EVENT_DATA parts, only the first carrying the topic. Parts of two
+// messages never interleave, so one buffer serves every topic. Nothing
+// larger than the biggest mailbox slot could be delivered anyway.
+#define MQTT_REASSEMBLY_MAX UPDATE_MAILBOX_MAX_SLOT_SIZE
+#define MQTT_TOPIC_MAX 256
+
+// Filters per SUBSCRIBE packet, with their bytes kept well inside the
+// client's default 1 KB output buffer
+#define MQTT_SUBSCRIBE_BATCH 16
+#define MQTT_SUBSCRIBE_BATCH_BYTES 768
+
+// SUBSCRIBE packets of the current connection not acknowledged yet, and
+// whether the broker has confirmed the whole filter set since boot
+static int pending_subacks;
+static bool subscriptions_confirmed;
+
+static struct {
+    char topic[MQTT_TOPIC_MAX];
+    size_t topic_len;
+    char data[MQTT_REASSEMBLY_MAX];
+    size_t total;       // size of the message being assembled, 0 if none
+    size_t received;
+    payload_encoding_t encoding;
+    bool discard;       // too large: parts are only counted until the message ends
+} reassembly;
+
+// Startup barrier bookkeeping, per subscribed filter, until the first frame
+// is released: the SUBACK, and for exact topics the first (retained)
+// message. A wildcard filter can deliver any number of retained messages,
+// so only the quiet period after the last SUBACK tells they are all in.
+typedef struct {
+    int msg_id;
+    bool subscribed;
+    bool delivered;
+} mqtt_startup_filter_t;
+
+static mqtt_startup_filter_t *startup_filters;
+static int startup_pending_subacks;     // filters, not packets
+static int startup_pending_messages;
+
+static void mqtt_startup_begin(int count)
+{
+    startup_filters = (mqtt_startup_filter_t *)calloc((size_t)count, sizeof(mqtt_startup_filter_t));
+    if (!startup_filters) {
+        return;
+    }
+    startup_pending_subacks = count;
+    startup_pending_messages = 0;
+    for (int i = 0; i < count; i++) {
+        const char *filter = topic_router_filter(i);
+        startup_filters[i].msg_id = -1;
+        startup_filters[i].delivered = strpbrk(filter, "+#") != NULL;
+        if (!startup_filters[i].delivered) startup_pending_messages++;
+    }
+}
+
+static void mqtt_startup_end(void)
+{
+    free(startup_filters);
+    startup_filters = NULL;
+    display_startup_complete();
+}
+
+// SUBACK of packet msg_id: codes holds one return code per filter of the
+// packet, in order
+static void mqtt_startup_suback(int msg_id, const char *codes, int num_codes)
+{
+    if (!startup_filters) {
+        return;
+    }
+    int position = 0;
+    for (int i = 0; i < topic_router_filter_count(); i++) {
+        mqtt_startup_filter_t *f = &startup_filters[i];
+        if (f->msg_id != msg_id || f->subscribed) continue;
+        bool granted = position >= num_codes || (uint8_t)codes[position] < 0x80;
+        position++;
+        f->subscribed = true;
+        startup_pending_subacks--;
+        // A refused subscription delivers nothing worth waiting for
+        if (!granted && !f->delivered) {
+            f->delivered = true;
+            startup_pending_messages--;
+        }
+    }
+    if (startup_pending_messages == 0 && startup_pending_subacks == 0) {
+        mqtt_startup_end();
+    } else if (startup_pending_subacks == 0) {
+        display_startup_subscribed();
+    }
+}
+
+static void mqtt_startup_message(const char *topic, size_t topic_len)
+{
+    if (!startup_filters) {
+        return;
+    }
+    // The display gave up waiting, stop checking every message
+    if (!display_startup_holding()) {
+        mqtt_startup_end();
+        return;
+    }
+    for (int i = 0; i < topic_router_filter_count(); i++) {
+        mqtt_startup_filter_t *f = &startup_filters[i];
+        const char *filter = topic_router_filter(i);
+        if (!f->delivered && strlen(filter) == topic_len && memcmp(filter, topic, topic_len) == 0) {
+            f->delivered = true;
+            startup_pending_messages--;
+        }
+    }
+    if (startup_pending_messages == 0 && startup_pending_subacks == 0) {
+        mqtt_startup_end();
+    }
+}
+
+static void mqtt_deliver(const char *topic, size_t topic_len, const char *data, size_t len, payload_encoding_t encoding)
+{
+    mqtt_stats.messages++;
+    mqtt_stats.bytes += (uint32_t)len;
+    display_update_widget_by_topic(topic, topic_len, data, len, encoding);
+    mqtt_startup_message(topic, topic_len);
+}
+
+static void mqtt_reassembly_abort(void)
+{
+    if (reassembly.total != 0) {
+        mqtt_stats.reassembly_errors++;
+        reassembly.total = 0;
+    }
+}
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+static bool mqtt5_content_type_is(const esp_mqtt5_event_property_t *property, const char *type)
+{
+    size_t n = strlen(type);
+    return (size_t)property->content_type_len == n && strncasecmp(property->content_type, type, n) == 0;
+}
+#endif
+
+// Whether the last level of topic is suffix, as in "sensors/kitchen/cbor"
+static bool mqtt_topic_suffix_is(const char *topic, size_t topic_len, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return topic_len > n && topic[topic_len - n - 1] == '/' && memcmp(topic + topic_len - n, suffix, n) == 0;
+}
+
+// The encoding of a message, from its MQTT 5 content type or else the last
+// topic level; JSON if neither names one. False if the widgets cannot decode it.
+static bool mqtt_payload_encoding(esp_mqtt_event_handle_t event, payload_encoding_t *encoding)
+{
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    const esp_mqtt5_event_property_t *property = event->property;
+    if (event->protocol_ver == MQTT_PROTOCOL_V_5 && property && property->content_type && property->content_type_len > 0) {
+        if (mqtt5_content_type_is(property, "application/json") || mqtt5_content_type_is(property, "json")) {
+            *encoding = PAYLOAD_JSON;
+        } else if (mqtt5_content_type_is(property, "application/cbor")) {
+            *encoding = PAYLOAD_CBOR;
+        } else if (mqtt5_content_type_is(property, "application/msgpack") ||
+                   mqtt5_content_type_is(property, "application/x-msgpack") ||
+                   mqtt5_content_type_is(property, "application/vnd.msgpack")) {
+            *encoding = PAYLOAD_MSGPACK;
+        } else {
+            return false;
+        }
+        return true;
+    }
+#endif
+    const char *topic = event->topic;
+    size_t topic_len = (size_t)event->topic_len;
+    if (mqtt_topic_suffix_is(topic, topic_len, "cbor")) {
+        *encoding = PAYLOAD_CBOR;
+    } else if (mqtt_topic_suffix_is(topic, topic_len, "msgpack")) {
+        *encoding = PAYLOAD_MSGPACK;
+    } else {
+        *encoding = PAYLOAD_JSON;
+    }
+    return true;
+}
+
+static void mqtt_handle_data(esp_mqtt_event_handle_t event)
+{
+    size_t offset = (size_t)event->current_data_offset;
+    size_t len = (size_t)event->data_len;
+    size_t total = (size_t)event->total_data_len;
+
+    // Only the first part carries the topic and properties; later parts of
+    // a message in an unsupported encoding are skipped
+    payload_encoding_t encoding = PAYLOAD_JSON;
+    if (offset == 0 && !mqtt_payload_encoding(event, &encoding)) {
+        mqtt_reassembly_abort();
+        mqtt_stats.unsupported++;
+        ESP_LOGW(TAG, "Dropping message on %.*s in an unsupported encoding", event->topic_len, event->topic);
+        if (len < total) {
+            reassembly.total = total;
+            reassembly.received = len;
+            reassembly.discard = true;
+        }
+        return;
+    }
+
+    if (offset == 0 && len == total) {
+        // Straight from the client's receive buffer, copied only into the mailbox
+        mqtt_reassembly_abort();
+        mqtt_deliver(event->topic, (size_t)event->topic_len, event->data, len, encoding);
+        return;
+    }
+
+    if (offset == 0) {
+        mqtt_reassembly_abort();
+        reassembly.total = total;
+        reassembly.received = 0;
+        reassembly.encoding = encoding;
+        reassembly.discard = total > MQTT_REASSEMBLY_MAX || (size_t)event->topic_len > MQTT_TOPIC_MAX;
+        if (reassembly.discard) {
+            mqtt_stats.oversize++;
+            ESP_LOGW(TAG, "Dropping %u byte message on %.*s", (unsigned)total, event->topic_len, event->topic);
+        } else {
+            memcpy(reassembly.topic, event->topic, (size_t)event->topic_len);
+            reassembly.topic_len = (size_t)event->topic_len;
+        }
+    } else if (reassembly.total == 0 || total != reassembly.total || offset != reassembly.received) {
+        // A part whose start we missed, e.g. across a reconnect
+        reassembly.total = 0;
+        mqtt_stats.reassembly_errors++;
+        return;
+    }
+    if (offset + len > total) {
+        reassembly.total = 0;
+        mqtt_stats.reassembly_errors++;
+        return;
+    }
+
+    if (!reassembly.discard) {
+        memcpy(reassembly.data + offset, event->data, len);
+    }
+    reassembly.received = offset + len;
+    if (reassembly.received < total) {
+        return;
+    }
+    reassembly.total = 0;
+    if (!reassembly.discard) {
+        mqtt_stats.reassembled++;
+        mqtt_deliver(reassembly.topic, reassembly.topic_len, reassembly.data, total, reassembly.encoding);
+    }
+}
+
+// A session resumed without subscribing: the broker only sends what it
+// queued, so wait for a SUBACK no more
+static void mqtt_startup_resumed(void)
+{
+    if (!startup_filters) {
+        return;
+    }
+    for (int i = 0; i < topic_router_filter_count(); i++) {
+        startup_filters[i].subscribed = true;
+    }
+    startup_pending_subacks = 0;
+    if (startup_pending_messages == 0) {
+        mqtt_startup_end();
+    } else {
+        display_startup_subscribed();
+    }
+}
+
+// Identifies what a persistent session holds: the client id and every
+// filter with its QoS
+static uint32_t mqtt_subscription_key(void)
+{
+    uint32_t h = 2166136261u;
+    for (int i = -1; i < topic_router_filter_count(); i++) {
+        const char *s = i < 0 ? client_id : topic_router_filter(i);
+        for (; *s; s++) {
+            h = (h ^ (uint8_t)*s) * 16777619u;
+        }
+        h = (h ^ (uint8_t)(i < 0 ? 0 : 1 + topic_router_filter_qos(i))) * 16777619u;
+    }
+    return h;
+}
+
+static uint32_t mqtt_stored_session(void)
+{
+    nvs_handle_t nvs;
+    uint32_t key = 0;
+    if (nvs_open(MQTT_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        nvs_get_u32(nvs, MQTT_NVS_SESSION_KEY, &key);
+        nvs_close(nvs);
+    }
+    return key;
+}
+
+static void mqtt_store_session(uint32_t key)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(MQTT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to open NVS, the session will not be resumed after a reboot");
+        return;
+    }
+    if (nvs_set_u32(nvs, MQTT_NVS_SESSION_KEY, key) == ESP_OK) {
+        nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+}
+
+// The whole filter set is acknowledged. With persistent sessions, remember
+// that the broker's session holds it and stop asking for clean sessions.
+static void mqtt_subscriptions_confirmed(esp_mqtt_client_handle_t client)
+{
+    subscriptions_confirmed = true;
+    if (!persistent_session || clean_session_off) {
+        return;
+    }
+    mqtt_store_session(session_key);
+    clean_session_off = true;
+#if ESP_IDF_VERSION_MAJOR >= 5
+    mqtt_cfg.session.disable_clean_session = true;
+#else
+    mqtt_cfg.disable_clean_session = true;
+#endif
+    if (esp_mqtt_set_config(client, &mqtt_cfg) == ESP_OK) {
+        ESP_LOGI(TAG, "Subscriptions confirmed, reconnects resume the session");
+    }
+}
+
+// Subscribe to the deduplicated filter set in as few SUBSCRIBE packets as
+// fit, each filter at its own QoS
+static void mqtt_subscribe_all(esp_mqtt_client_handle_t client)
+{
+    esp_mqtt_topic_t batch[MQTT_SUBSCRIBE_BATCH];
+    int count = topic_router_filter_count();
+    pending_subacks = 0;
+    for (int first = 0; first < count;) {
+        int n = 0;
+        size_t bytes = 0;
+        while (first + n < count && n < MQTT_SUBSCRIBE_BATCH) {
+            const char *filter = topic_router_filter(first + n);
+            // Length prefix and options byte
+            size_t cost = strlen(filter) + 3;
+            if (n > 0 && bytes + cost > MQTT_SUBSCRIBE_BATCH_BYTES) break;
+            batch[n].filter = filter;
+            batch[n].qos = topic_router_filter_qos(first + n);
+            bytes += cost;
+            n++;
+        }
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+        int msg_id = esp_mqtt_client_subscribe_multiple(client, batch, n);
+#else
+        n = 1;
+        int msg_id = esp_mqtt_client_subscribe(client, batch[0].filter, batch[0].qos);
+#endif
+        if (msg_id < 0) {
+            ESP_LOGW(TAG, "Failed to subscribe to %d filter(s) from %s", n, batch[0].filter);
+        } else {
+            ESP_LOGI(TAG, "Subscribing to %d filter(s) from %s, msg_id=%d", n, batch[0].filter, msg_id);
+            pending_subacks++;
+            mqtt_stats.subscribe_packets++;
+        }
+        // Acknowledgements of an earlier connection's subscribes never come
+        for (int i = first; startup_filters && i < first + n; i++) {
+            if (!startup_filters[i].subscribed) startup_filters[i].msg_id = msg_id;
+        }
+        first += n;
+    }
+}
+
 static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id, void *event_data)
 {
     ESP_LOGD(TAG, "Event dispatched from event loop base=%s, event_id=%d", base, (int)event_id);
     esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
     esp_mqtt_client_handle_t client = event->client;
-    int msg_id;
 
     switch (event->event_id) {
         case MQTT_EVENT_CONNECTED: {
-            ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-            const app_config_t *config = get_config();
-            if (config) {
-                for (int i = 0; i < config->num_widgets; i++) {
-                    msg_id = esp_mqtt_client_subscribe(client, config->widgets[i].topic, 1);
-                    ESP_LOGI(TAG, "sent subscribe successful, msg_id=%d, topic=%s", msg_id, config->widgets[i].topic);
-                }
+            ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED, session_present=%d", event->session_present);
+            // The broker kept the session, and with it the confirmed
+            // subscriptions; what it queued meanwhile follows on its own
+            if (event->session_present && subscriptions_confirmed) {
+                mqtt_stats.resubscribes_skipped++;
+                mqtt_startup_resumed();
+                break;
             }
+            mqtt_subscribe_all(client);
             break;
         }
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            mqtt_reassembly_abort();
             break;
         case MQTT_EVENT_SUBSCRIBED:
             ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+            if (pending_subacks > 0 && --pending_subacks == 0) mqtt_subscriptions_confirmed(client);
+            // One SUBACK return code per filter of the packet, 0x80 for a refused one
+            mqtt_startup_suback(event->msg_id, event->data, event->data_len);
             break;
         case MQTT_EVENT_UNSUBSCRIBED:
             ESP_LOGI(TAG, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
@@ -42,24 +443,12 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         case MQTT_EVENT_PUBLISHED:
             ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
             break;
-        case MQTT_EVENT_DATA: {
-            ESP_LOGI(TAG, "MQTT_EVENT_DATA");
-            char *topic = (char *)malloc((size_t)event->topic_len + 1);
-            char *data = (char *)malloc((size_t)event->data_len + 1);
-            if (!topic || !data) {
-                free(topic);
-                free(data);
-                break;
-            }
-            memcpy(topic, event->topic, (size_t)event->topic_len);
-            topic[event->topic_len] = '\0';
-            memcpy(data, event->data, (size_t)event->data_len);
-            data[event->data_len] = '\0';
-            display_update_widget_by_topic(topic, data);
-            free(topic);
-            free(data);
+        case MQTT_EVENT_DATA:
+            ESP_LOGD(TAG, "MQTT_EVENT_DATA");
+            alloc_probe_enter(ALLOC_PROBE_MQTT);
+            mqtt_handle_data(event);
+            alloc_probe_exit(ALLOC_PROBE_MQTT);
             break;
-        }
         case MQTT_EVENT_ERROR:
             ESP_LOGI(TAG, "MQTT_EVENT_ERROR");
             break;
@@ -69,6 +458,34 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 }
 
+#ifdef CONFIG_MQTT_PROTOCOL_5
+static void mqtt5_set_connect_properties(esp_mqtt_client_handle_t client, const app_config_t *config)
+{
+    esp_mqtt5_connection_property_config_t props = {0};
+    // Without an expiry an MQTT 5 session ends with the connection
+    props.session_expiry_interval = persistent_session ? (uint32_t)config->mqtt.session_expiry_s : 0;
+    // Each widget's mailbox slot holds one pending payload
+    int receive_max = config->mqtt.receive_maximum > 0 ? config->mqtt.receive_maximum : config->num_widgets;
+    if (receive_max < 1) receive_max = 1;
+    if (receive_max > UINT16_MAX) receive_max = UINT16_MAX;
+    props.receive_maximum = (uint16_t)receive_max;
+    props.topic_alias_maximum = (uint16_t)config->mqtt.topic_alias_maximum;
+    // Larger messages would be dropped here anyway, the broker need not send them
+    props.maximum_packet_size = MQTT_REASSEMBLY_MAX + MQTT_TOPIC_MAX + MQTT5_PACKET_OVERHEAD;
+
+    esp_mqtt5_user_property_item_t encodings[] = {
+        { MQTT5_ENCODINGS_PROPERTY, MQTT5_ENCODINGS },
+    };
+    esp_mqtt5_client_set_user_property(&props.user_property, encodings, sizeof(encodings) / sizeof(encodings[0]));
+    if (esp_mqtt5_client_set_connect_property(client, &props) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set MQTT 5 connect properties");
+    }
+    esp_mqtt5_client_delete_user_property(props.user_property);
+    ESP_LOGI(TAG, "MQTT 5: receive maximum %d, %d topic aliases, session expiry %u s",
+             receive_max, config->mqtt.topic_alias_maximum, (unsigned)props.session_expiry_interval);
+}
+#endif
+
 void mqtt_app_start(void)
 {
     const app_config_t *config = get_config();
@@ -77,23 +494,78 @@ void mqtt_app_start(void)
         return;
     }
 
-    char broker_url[256];
     snprintf(broker_url, sizeof(broker_url), "mqtt://%s:%d", config->mqtt.server, config->mqtt.port);
 
-    esp_mqtt_client_config_t mqtt_cfg = {0};
+    // A session is found again only under the same client id
+    if (config->mqtt.client_id[0]) {
+        snprintf(client_id, sizeof(client_id), "%s", config->mqtt.client_id);
+    } else {
+        uint8_t mac[6] = {0};
+        esp_read_mac(mac, ESP_MAC_WIFI_STA);
+        snprintf(client_id, sizeof(client_id), "eink-%02x%02x%02x", mac[3], mac[4], mac[5]);
+    }
+
+    // A session left behind by another subscription set would keep
+    // delivering its old filters, so that one is replaced by a clean session
+    // first. Resuming at boot also needs the widget data from the snapshot,
+    // as the retained values are not sent again.
+    persistent_session = config->mqtt.persistent_session;
+    session_key = mqtt_subscription_key();
+    bool resume = persistent_session && mqtt_stored_session() == session_key;
+    clean_session_off = resume;
+    subscriptions_confirmed = resume && display_restored_from_snapshot();
+    ESP_LOGI(TAG, "Client id %s, %s session", client_id, resume ? "resuming the" : persistent_session ? "new persistent" : "clean");
+
+    memset(&mqtt_cfg, 0, sizeof(mqtt_cfg));
 #if ESP_IDF_VERSION_MAJOR >= 5
     mqtt_cfg.broker.address.uri = broker_url;
     mqtt_cfg.credentials.username = config->mqtt.username;
     mqtt_cfg.credentials.authentication.password = config->mqtt.password;
-    mqtt_cfg.credentials.client_id = config->mqtt.client_id;
+    mqtt_cfg.credentials.client_id = client_id;
+    mqtt_cfg.session.disable_clean_session = resume;
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    if (config->mqtt.version == 5) {
+        mqtt_cfg.session.protocol_ver = MQTT_PROTOCOL_V_5;
+    }
+#endif
 #else
     mqtt_cfg.uri = broker_url;
     mqtt_cfg.username = config->mqtt.username;
     mqtt_cfg.password = config->mqtt.password;
-    mqtt_cfg.client_id = config->mqtt.client_id;
+    mqtt_cfg.client_id = client_id;
+    mqtt_cfg.disable_clean_session = resume;
 #endif
 
+    if (topic_router_filter_count() > 0) {
+        mqtt_startup_begin(topic_router_filter_count());
+    }
+
     esp_mqtt_client_handle_t client = esp_mqtt_client_init(&mqtt_cfg);
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    if (config->mqtt.version == 5) {
+        mqtt5_set_connect_properties(client, config);
+    }
+#endif
     esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, client);
     esp_mqtt_client_start(client);
+    mqtt_client = client;
+}
+
+void mqtt_app_get_stats(mqtt_stats_t *out)
+{
+    *out = mqtt_stats;
+}
+
+bool mqtt_app_publish(const char *topic, const char *payload)
+{
+    if (!mqtt_client) {
+        return false;
+    }
+    // Enqueued rather than sent inline, callers may be outside the MQTT task
+    int msg_id = esp_mqtt_client_enqueue(mqtt_client, topic, payload, 0, 1, 0, true);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Failed to publish to %s", topic);
+        return false;
+    }
+    return true;
 }
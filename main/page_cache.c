@@ -0,0 +1,109 @@
+#include "page_cache.h"
+#include "rle.h"
+#include "esp_log.h"
+#include <stdlib.h>
+
+static const char *TAG = "PAGE_CACHE";
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    int page;
+    bool in_use;
+    bool valid;     // in use and still matching the page's content
+    uint32_t used;  // LRU tick
+} page_slot_t;
+
+static page_slot_t slots[PAGE_CACHE_SLOTS];
+static uint32_t tick;
+static page_cache_stats_t stats;
+
+static page_slot_t *find(int page)
+{
+    for (int i = 0; i < PAGE_CACHE_SLOTS; i++) {
+        if (slots[i].in_use && slots[i].page == page) return &slots[i];
+    }
+    return NULL;
+}
+
+static void release(page_slot_t *slot)
+{
+    stats.bytes_used -= slot->len;
+    free(slot->data);
+    slot->data = NULL;
+    slot->len = 0;
+    slot->in_use = false;
+    slot->valid = false;
+}
+
+void page_cache_clear(void)
+{
+    for (int i = 0; i < PAGE_CACHE_SLOTS; i++) {
+        if (slots[i].in_use) release(&slots[i]);
+    }
+}
+
+bool page_cache_store(int page, const uint8_t *frame, size_t len)
+{
+    size_t packed = rle_encoded_size(frame, len);
+    page_slot_t *slot = find(page);
+    if (packed > len / 2) {
+        ESP_LOGD(TAG, "Page %d compresses to %u bytes, not cached", page, (unsigned)packed);
+        if (slot) release(slot);
+        return false;
+    }
+
+    if (!slot) {
+        // Free slot, else the least recently used one
+        slot = &slots[0];
+        for (int i = 0; i < PAGE_CACHE_SLOTS; i++) {
+            if (!slots[i].in_use) { slot = &slots[i]; break; }
+            if (slots[i].used < slot->used) slot = &slots[i];
+        }
+        if (slot->in_use) release(slot);
+    }
+
+    uint8_t *data = (uint8_t *)realloc(slot->data, packed);
+    if (!data) {
+        if (slot->in_use) release(slot);
+        return false;
+    }
+    stats.bytes_used = stats.bytes_used - slot->len + packed;
+    slot->data = data;
+    slot->len = rle_encode(frame, len, data, packed);
+    slot->page = page;
+    slot->in_use = true;
+    slot->valid = true;
+    slot->used = ++tick;
+    stats.stores++;
+    return true;
+}
+
+bool page_cache_load(int page, uint8_t *frame, size_t len)
+{
+    page_slot_t *slot = find(page);
+    if (!slot || !slot->valid || rle_decode(slot->data, slot->len, frame, len) != len) {
+        stats.misses++;
+        return false;
+    }
+    slot->used = ++tick;
+    stats.hits++;
+    return true;
+}
+
+bool page_cache_valid(int page)
+{
+    page_slot_t *slot = find(page);
+    return slot && slot->valid;
+}
+
+void page_cache_invalidate(int page)
+{
+    page_slot_t *slot = find(page);
+    if (slot) slot->valid = false;
+}
+
+void page_cache_get_stats(page_cache_stats_t *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,40 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compressed full frames of dashboard pages, so a page flip is a decode and
+// a panel upload. Holds the current page and its neighbours; storing a
+// fourth page evicts the least recently used one. Frames whose compressed
+// size exceeds half the raw size are not kept.
+
+#define PAGE_CACHE_SLOTS 3
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t stores;
+    size_t bytes_used;
+} page_cache_stats_t;
+
+void page_cache_clear(void);
+bool page_cache_store(int page, const uint8_t *frame, size_t len);
+// Decode page into frame, false if it is not cached or was invalidated
+bool page_cache_load(int page, uint8_t *frame, size_t len);
+bool page_cache_valid(int page);
+// The page's content changed, its frame has to be rendered again
+void page_cache_invalidate(int page);
+
+void page_cache_get_stats(page_cache_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PAGE_CACHE_H
@@ -0,0 +1,74 @@
+#include "rle.h"
+#include <string.h>
+
+// Length of the run of equal bytes starting at src[i], at most 128
+static size_t run_length(const uint8_t *src, size_t i, size_t len)
+{
+    size_t n = 1;
+    while (i + n < len && n < 128 && src[i + n] == src[i]) n++;
+    return n;
+}
+
+// Encode src as PackBits packets into dst, or only count the encoded size when dst is NULL
+static size_t rle_pack(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap)
+{
+    size_t out = 0;
+    size_t i = 0;
+    while (i < len) {
+        size_t run = run_length(src, i, len);
+        if (run >= 3) {
+            if (dst) {
+                if (out + 2 > dst_cap) return 0;
+                dst[out] = (uint8_t)(257 - run);
+                dst[out + 1] = src[i];
+            }
+            out += 2;
+            i += run;
+            continue;
+        }
+
+        // Literal stretch up to the next run of three or more
+        size_t start = i;
+        while (i < len && i - start < 128 && run_length(src, i, len) < 3) i++;
+        size_t n = i - start;
+        if (dst) {
+            if (out + 1 + n > dst_cap) return 0;
+            dst[out] = (uint8_t)(n - 1);
+            memcpy(&dst[out + 1], &src[start], n);
+        }
+        out += 1 + n;
+    }
+    return out;
+}
+
+size_t rle_encoded_size(const uint8_t *src, size_t len)
+{
+    return rle_pack(src, len, NULL, 0);
+}
+
+size_t rle_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap)
+{
+    return rle_pack(src, len, dst, dst_cap);
+}
+
+size_t rle_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap)
+{
+    size_t out = 0;
+    size_t i = 0;
+    while (i < len) {
+        uint8_t header = src[i++];
+        if (header < 128) {
+            size_t n = (size_t)header + 1;
+            if (i + n > len || out + n > dst_cap) return 0;
+            memcpy(&dst[out], &src[i], n);
+            i += n;
+            out += n;
+        } else if (header > 128) {
+            size_t n = 257 - (size_t)header;
+            if (i >= len || out + n > dst_cap) return 0;
+            memset(&dst[out], src[i++], n);
+            out += n;
+        }
+    }
+    return out;
+}
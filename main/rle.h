@@ -0,0 +1,26 @@
+#ifndef RLE_H
+#define RLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// PackBits run-length coding. Packed 1bpp dashboard frames are mostly long
+// runs of 0x00, which this shrinks to a few percent of their size; the
+// worst case grows by one byte per 128.
+
+// Encoded size of src, to size the output buffer exactly
+size_t rle_encoded_size(const uint8_t *src, size_t len);
+// Returns the encoded length, 0 if it does not fit in dst_cap
+size_t rle_encode(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap);
+// Returns the decoded length, 0 on malformed input or if it does not fit
+size_t rle_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t dst_cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RLE_H
@@ -0,0 +1,262 @@
+#include "snapshot.h"
+#include "rle.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#else
+#include <stdio.h>
+#define ESP_LOGI(tag, fmt, ...) printf("I %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) printf("W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGE(tag, fmt, ...) printf("E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#endif
+
+static const char *TAG = "SNAPSHOT";
+
+#define SNAPSHOT_MAGIC 0x534e4150u  // "SNAP"
+
+// At the start of a snapshot's first sector, written after the payload
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t key;
+    uint32_t page;
+    uint32_t frame_len;     // raw frame size
+    uint32_t frame_stored;  // run-length coded size that follows the header
+    uint32_t data_len;      // total of the parts, after the frame
+    uint32_t crc;           // over the payload and the fields above but seq
+} snapshot_header_t;
+
+static struct {
+    histlog_flash_t flash;
+    bool mounted;
+    int sectors;
+    int newest;             // sector of the newest snapshot, -1 if none
+    int next;               // sector the next snapshot starts at
+    uint32_t seq;           // of the newest snapshot
+    uint32_t last_crc;
+    snapshot_stats_t stats;
+} ss;
+
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+static size_t sector_offset(int sector)
+{
+    return (size_t)sector * SNAPSHOT_SECTOR_SIZE;
+}
+
+static int sectors_for(size_t bytes)
+{
+    return (int)((bytes + SNAPSHOT_SECTOR_SIZE - 1) / SNAPSHOT_SECTOR_SIZE);
+}
+
+// Leaves seq out, so equal content gives an equal CRC
+static uint32_t snapshot_crc(uint32_t payload_crc, const snapshot_header_t *header)
+{
+    snapshot_header_t fields = *header;
+    fields.seq = 0;
+    return crc32_update(payload_crc, &fields, offsetof(snapshot_header_t, crc));
+}
+
+// A snapshot may wrap around the end of the partition. Reads and writes
+// take an offset from the start of the snapshot's first sector.
+static bool snapshot_io(int start, size_t offset, void *buf, size_t len, bool write)
+{
+    size_t size = sector_offset(ss.sectors);
+    size_t pos = (sector_offset(start) + offset) % size;
+    uint8_t *p = (uint8_t *)buf;
+    while (len > 0) {
+        size_t n = len < size - pos ? len : size - pos;
+        bool ok = write ? ss.flash.write(ss.flash.ctx, pos, p, n) : ss.flash.read(ss.flash.ctx, pos, p, n);
+        if (!ok) return false;
+        p += n;
+        len -= n;
+        pos = 0;
+    }
+    return true;
+}
+
+static bool snapshot_write(int start, size_t offset, const void *data, size_t len)
+{
+    return snapshot_io(start, offset, (void *)data, len, true);
+}
+
+static bool snapshot_read(int start, size_t offset, void *buf, size_t len)
+{
+    return snapshot_io(start, offset, buf, len, false);
+}
+
+static bool snapshot_erase(int start, int count)
+{
+    int head = start + count <= ss.sectors ? count : ss.sectors - start;
+    return ss.flash.erase(ss.flash.ctx, sector_offset(start), sector_offset(head)) &&
+           (head == count || ss.flash.erase(ss.flash.ctx, 0, sector_offset(count - head)));
+}
+
+static bool read_header(int sector, snapshot_header_t *header)
+{
+    return ss.flash.read(ss.flash.ctx, sector_offset(sector), header, sizeof(*header)) &&
+           header->magic == SNAPSHOT_MAGIC &&
+           sectors_for(sizeof(*header) + header->frame_stored + header->data_len) * 2 <= ss.sectors;
+}
+
+bool snapshot_mount(const histlog_flash_t *flash)
+{
+    memset(&ss, 0, sizeof(ss));
+    ss.flash = *flash;
+    ss.sectors = (int)(flash->size / SNAPSHOT_SECTOR_SIZE);
+    ss.newest = -1;
+    if (ss.sectors < 2) {
+        ESP_LOGE(TAG, "Partition too small for snapshots");
+        return false;
+    }
+
+    // Continue after the newest snapshot
+    for (int s = 0; s < ss.sectors; s++) {
+        snapshot_header_t header;
+        if (!read_header(s, &header) || (ss.newest >= 0 && (int32_t)(header.seq - ss.seq) <= 0)) {
+            continue;
+        }
+        ss.newest = s;
+        ss.seq = header.seq;
+        ss.last_crc = header.crc;
+        ss.next = (s + sectors_for(sizeof(header) + header.frame_stored + header.data_len)) % ss.sectors;
+    }
+    ss.mounted = true;
+    ESP_LOGI(TAG, "Mounted %d sectors, newest snapshot %u", ss.sectors, (unsigned)ss.seq);
+    return true;
+}
+
+bool snapshot_save(uint32_t key, uint32_t page, const uint8_t *frame, size_t frame_len,
+                   const snapshot_part_t *parts, int num_parts)
+{
+    if (!ss.mounted) {
+        return false;
+    }
+
+    size_t stored = rle_encoded_size(frame, frame_len);
+    uint8_t *coded = (uint8_t *)malloc(stored);
+    if (!coded) {
+        ss.stats.write_errors++;
+        return false;
+    }
+    rle_encode(frame, frame_len, coded, stored);
+
+    snapshot_header_t header = {
+        .magic = SNAPSHOT_MAGIC,
+        .seq = ss.seq + 1,
+        .key = key,
+        .page = page,
+        .frame_len = (uint32_t)frame_len,
+        .frame_stored = (uint32_t)stored,
+    };
+    for (int i = 0; i < num_parts; i++) {
+        header.data_len += (uint32_t)parts[i].len;
+    }
+    uint32_t crc = crc32_update(0, coded, stored);
+    for (int i = 0; i < num_parts; i++) {
+        crc = crc32_update(crc, parts[i].data, parts[i].len);
+    }
+    header.crc = snapshot_crc(crc, &header);
+    if (ss.newest >= 0 && header.crc == ss.last_crc) {
+        free(coded);
+        ss.stats.unchanged++;
+        return true;
+    }
+
+    // Must not reach into the newest snapshot, which stays valid until the new
+    // one is complete. Both take at most half the partition and the new one
+    // starts right after the newest, wrapping around the end, so they never meet.
+    int count = sectors_for(sizeof(header) + stored + header.data_len);
+    if (count * 2 > ss.sectors) {
+        ESP_LOGW(TAG, "Snapshot of %u bytes does not fit", (unsigned)(sizeof(header) + stored + header.data_len));
+        free(coded);
+        ss.stats.write_errors++;
+        return false;
+    }
+    int start = ss.next;
+
+    bool ok = snapshot_erase(start, count);
+    if (ok) ss.stats.sectors_erased += (uint32_t)count;
+    size_t offset = sizeof(header);
+    ok = ok && snapshot_write(start, offset, coded, stored);
+    offset += stored;
+    for (int i = 0; ok && i < num_parts; i++) {
+        if (parts[i].len == 0) continue;
+        ok = snapshot_write(start, offset, parts[i].data, parts[i].len);
+        offset += parts[i].len;
+    }
+    free(coded);
+    ok = ok && snapshot_write(start, 0, &header, sizeof(header));
+    if (!ok) {
+        ss.stats.write_errors++;
+        return false;
+    }
+
+    ss.newest = start;
+    ss.seq = header.seq;
+    ss.last_crc = header.crc;
+    ss.next = (start + count) % ss.sectors;
+    ss.stats.saves++;
+    ss.stats.last_bytes = (uint32_t)(sizeof(header) + stored + header.data_len);
+    return true;
+}
+
+// Only the newest snapshot matches what the panel shows; an older one is
+// never used in its place
+bool snapshot_load(uint32_t key, uint32_t *page, uint8_t *frame, size_t frame_len,
+                   const snapshot_part_t *parts, int num_parts)
+{
+    snapshot_header_t header;
+    if (!ss.mounted || ss.newest < 0 || !read_header(ss.newest, &header)) {
+        return false;
+    }
+    size_t data_len = 0;
+    for (int i = 0; i < num_parts; i++) {
+        data_len += parts[i].len;
+    }
+    if (header.key != key || header.frame_len != frame_len || header.data_len != data_len) {
+        ESP_LOGI(TAG, "Snapshot is for another configuration");
+        return false;
+    }
+
+    size_t total = (size_t)header.frame_stored + header.data_len;
+    uint8_t *payload = (uint8_t *)malloc(total);
+    if (!payload) {
+        return false;
+    }
+    bool ok = snapshot_read(ss.newest, sizeof(header), payload, total) &&
+              snapshot_crc(crc32_update(0, payload, total), &header) == header.crc;
+    if (!ok) {
+        ss.stats.corrupt++;
+    }
+    // The frame is only overwritten once the CRC has checked out
+    ok = ok && rle_decode(payload, header.frame_stored, frame, frame_len) == frame_len;
+    if (ok) {
+        const uint8_t *data = payload + header.frame_stored;
+        for (int i = 0; i < num_parts; i++) {
+            if (parts[i].len) memcpy(parts[i].data, data, parts[i].len);
+            data += parts[i].len;
+        }
+        *page = header.page;
+    }
+    free(payload);
+    return ok;
+}
+
+void snapshot_get_stats(snapshot_stats_t *out)
+{
+    *out = ss.stats;
+}
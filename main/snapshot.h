@@ -0,0 +1,59 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "histlog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Last committed frame and widget data store, kept in a raw flash partition
+// so a reboot can pick up partial updates where it left off.
+//
+// Snapshots are written round-robin through the partition's 4 KB sectors,
+// each starting on a sector boundary and wrapping around the partition's
+// end, at most half the partition each: the run-length coded frame and the
+// data parts go first, the header with sequence number and CRC last, so a
+// snapshot torn by a reset is never mistaken for a valid one. Only the newest
+// snapshot is loaded, as it is what the panel still shows. A save whose
+// content equals the last one is skipped. Flash access goes through
+// histlog_flash_t.
+
+#define SNAPSHOT_SECTOR_SIZE 4096
+
+// One block of the data store, saved and restored verbatim
+typedef struct {
+    void *data;
+    size_t len;
+} snapshot_part_t;
+
+typedef struct {
+    uint32_t saves;
+    uint32_t unchanged;         // saves skipped because nothing changed
+    uint32_t sectors_erased;
+    uint32_t write_errors;
+    uint32_t corrupt;           // snapshots rejected by their CRC while loading
+    uint32_t last_bytes;        // stored size of the newest snapshot
+} snapshot_stats_t;
+
+bool snapshot_mount(const histlog_flash_t *flash);
+
+// Save frame (compressed) and the parts. key identifies the data layout;
+// a snapshot only loads for the same key. page is stored alongside.
+bool snapshot_save(uint32_t key, uint32_t page, const uint8_t *frame, size_t frame_len,
+                   const snapshot_part_t *parts, int num_parts);
+// Fill frame and the parts from the newest valid snapshot saved under key
+// with the same sizes. Nothing is modified when false is returned.
+bool snapshot_load(uint32_t key, uint32_t *page, uint8_t *frame, size_t frame_len,
+                   const snapshot_part_t *parts, int num_parts);
+
+void snapshot_get_stats(snapshot_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,333 @@
+#include "topic_router.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *text;       // points into the loaded config
+    uint16_t len;
+    uint16_t first_target;  // range in targets[]
+    uint16_t num_targets;
+    uint8_t qos;
+} router_filter_t;
+
+typedef struct {
+    uint32_t hash;
+    int16_t filter;         // -1 marks an empty bucket
+} router_bucket_t;
+
+// One topic level of a wildcard filter; '+' and '#' are ordinary nodes
+typedef struct {
+    const char *level;
+    uint16_t level_len;
+    int16_t first_child;
+    int16_t next_sibling;
+    int16_t filter;         // filter ending at this node, -1 if none
+} router_node_t;
+
+static struct {
+    router_filter_t *filters;
+    int num_filters;
+    uint16_t *targets;
+    router_bucket_t *buckets;
+    uint32_t bucket_mask;
+    router_node_t *nodes;
+    int num_nodes;
+} router;
+
+static uint32_t hash_topic(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool topic_router_filter_valid(const char *filter)
+{
+    if (filter[0] == '\0') {
+        return false;
+    }
+    for (const char *level = filter;;) {
+        const char *end = strchr(level, '/');
+        size_t len = end ? (size_t)(end - level) : strlen(level);
+        const char *wild = strpbrk(level, "+#");
+        if (wild && (!end || wild < end)) {
+            if (len != 1) return false;
+            if (*wild == '#' && end) return false;
+        }
+        if (!end) return true;
+        level = end + 1;
+    }
+}
+
+static bool is_level(const char *level, size_t len, char c)
+{
+    return len == 1 && level[0] == c;
+}
+
+bool topic_router_filters_overlap(const char *a, const char *b)
+{
+    for (bool first = true;; first = false) {
+        size_t a_len = strcspn(a, "/");
+        size_t b_len = strcspn(b, "/");
+        bool a_wild = is_level(a, a_len, '+') || is_level(a, a_len, '#');
+        bool b_wild = is_level(b, b_len, '+') || is_level(b, b_len, '#');
+        // Wildcards at the first level do not match topics starting with '$'
+        if (first && ((a_wild && b[0] == '$') || (b_wild && a[0] == '$'))) return false;
+        if (is_level(a, a_len, '#') || is_level(b, b_len, '#')) return true;
+        if (!a_wild && !b_wild && (a_len != b_len || memcmp(a, b, a_len) != 0)) return false;
+        a += a_len;
+        b += b_len;
+        if (*a == '\0' || *b == '\0') {
+            // "a/#" also matches "a"
+            return *a == *b || strcmp(*a ? a : b, "/#") == 0;
+        }
+        a++;
+        b++;
+    }
+}
+
+// Only for filters that passed topic_router_filter_valid, where '+' and '#'
+// can only appear as whole levels
+static bool is_wildcard(const char *filter)
+{
+    return strpbrk(filter, "+#") != NULL;
+}
+
+static void router_free(void)
+{
+    free(router.filters);
+    free(router.targets);
+    free(router.buckets);
+    free(router.nodes);
+    memset(&router, 0, sizeof(router));
+}
+
+static void bucket_insert(int16_t filter)
+{
+    const router_filter_t *f = &router.filters[filter];
+    uint32_t hash = hash_topic(f->text, f->len);
+    uint32_t i = hash & router.bucket_mask;
+    while (router.buckets[i].filter >= 0) {
+        i = (i + 1) & router.bucket_mask;
+    }
+    router.buckets[i].hash = hash;
+    router.buckets[i].filter = filter;
+}
+
+static void trie_insert(int16_t filter)
+{
+    const router_filter_t *f = &router.filters[filter];
+    int16_t node = 0;
+    size_t pos = 0;
+
+    for (;;) {
+        const char *slash = memchr(f->text + pos, '/', f->len - pos);
+        size_t end = slash ? (size_t)(slash - f->text) : f->len;
+        const char *level = f->text + pos;
+        uint16_t level_len = (uint16_t)(end - pos);
+
+        int16_t child = router.nodes[node].first_child;
+        while (child >= 0 && (router.nodes[child].level_len != level_len ||
+                              memcmp(router.nodes[child].level, level, level_len) != 0)) {
+            child = router.nodes[child].next_sibling;
+        }
+        if (child < 0) {
+            child = (int16_t)router.num_nodes++;
+            router.nodes[child] = (router_node_t){
+                .level = level,
+                .level_len = level_len,
+                .first_child = -1,
+                .next_sibling = router.nodes[node].first_child,
+                .filter = -1,
+            };
+            router.nodes[node].first_child = child;
+        }
+        node = child;
+
+        if (!slash) break;
+        pos = end + 1;
+    }
+    router.nodes[node].filter = filter;
+}
+
+// Topic and QoS of routing target i: a widget, or the batch topic after them
+static const char *target_topic(const app_config_t *config, int i, int *qos)
+{
+    if (i < config->num_widgets) {
+        *qos = config->widgets[i].qos;
+        return config->widgets[i].topic;
+    }
+    *qos = TOPIC_ROUTER_BATCH_QOS;
+    return config->mqtt.batch_topic;
+}
+
+bool topic_router_build(const app_config_t *config)
+{
+    router_free();
+    if (config->num_widgets == 0) {
+        return true;
+    }
+    int n = config->num_widgets + 1;
+
+    router.filters = (router_filter_t *)calloc((size_t)n, sizeof(router_filter_t));
+    router.targets = (uint16_t *)calloc((size_t)n, sizeof(uint16_t));
+    int16_t *widget_filter = (int16_t *)calloc((size_t)n, sizeof(int16_t));
+    if (!router.filters || !router.targets || !widget_filter) {
+        free(widget_filter);
+        router_free();
+        return false;
+    }
+
+    // Deduplicate filters and count widgets per filter
+    int num_exact = 0;
+    size_t trie_levels = 1;
+    for (int i = 0; i < n; i++) {
+        int qos;
+        const char *topic = target_topic(config, i, &qos);
+        if (!topic_router_filter_valid(topic)) {
+            widget_filter[i] = -1;
+            continue;
+        }
+        int f = 0;
+        while (f < router.num_filters && strcmp(router.filters[f].text, topic) != 0) f++;
+        if (f == router.num_filters) {
+            router.filters[f].text = topic;
+            router.filters[f].len = (uint16_t)strlen(topic);
+            router.num_filters++;
+            if (is_wildcard(topic)) {
+                for (const char *p = topic; *p; p++) trie_levels += (*p == '/');
+                trie_levels++;
+            } else {
+                num_exact++;
+            }
+        }
+        router.filters[f].num_targets++;
+        if (qos > router.filters[f].qos) router.filters[f].qos = (uint8_t)qos;
+        widget_filter[i] = (int16_t)f;
+    }
+
+    // Group widget indices by filter
+    uint16_t next = 0;
+    for (int f = 0; f < router.num_filters; f++) {
+        router.filters[f].first_target = next;
+        next += router.filters[f].num_targets;
+        router.filters[f].num_targets = 0;
+    }
+    for (int i = 0; i < n; i++) {
+        if (widget_filter[i] < 0) continue;
+        router_filter_t *f = &router.filters[widget_filter[i]];
+        router.targets[f->first_target + f->num_targets++] = (uint16_t)i;
+    }
+    free(widget_filter);
+
+    uint32_t buckets = 4;
+    while (buckets < (uint32_t)num_exact * 2) buckets <<= 1;
+    router.buckets = (router_bucket_t *)malloc(buckets * sizeof(router_bucket_t));
+    router.nodes = (router_node_t *)malloc(trie_levels * sizeof(router_node_t));
+    if (!router.buckets || !router.nodes) {
+        router_free();
+        return false;
+    }
+    router.bucket_mask = buckets - 1;
+    for (uint32_t i = 0; i < buckets; i++) {
+        router.buckets[i].filter = -1;
+    }
+    router.nodes[0] = (router_node_t){ .first_child = -1, .next_sibling = -1, .filter = -1 };
+    router.num_nodes = 1;
+
+    for (int16_t f = 0; f < router.num_filters; f++) {
+        if (is_wildcard(router.filters[f].text)) {
+            trie_insert(f);
+        } else {
+            bucket_insert(f);
+        }
+    }
+    return true;
+}
+
+static int emit(int16_t filter, uint16_t *out, int max, int count)
+{
+    const router_filter_t *f = &router.filters[filter];
+    for (int i = 0; i < f->num_targets; i++, count++) {
+        if (count < max) out[count] = router.targets[f->first_target + i];
+    }
+    return count;
+}
+
+// pos is the start of the next topic level, or -1 once all levels are consumed
+static int trie_match(int16_t node, const char *topic, size_t len, long pos, uint16_t *out, int max, int count)
+{
+    const router_node_t *n = &router.nodes[node];
+
+    if (pos < 0) {
+        if (n->filter >= 0) count = emit(n->filter, out, max, count);
+        // "a/#" also matches "a"
+        for (int16_t c = n->first_child; c >= 0; c = router.nodes[c].next_sibling) {
+            const router_node_t *child = &router.nodes[c];
+            if (child->level_len == 1 && child->level[0] == '#' && child->filter >= 0) {
+                count = emit(child->filter, out, max, count);
+            }
+        }
+        return count;
+    }
+
+    const char *level = topic + pos;
+    const char *slash = memchr(level, '/', len - (size_t)pos);
+    size_t level_len = slash ? (size_t)(slash - level) : len - (size_t)pos;
+    long next = slash ? (long)(slash - topic) + 1 : -1;
+    // Wildcards at the first level do not match topics starting with '$'
+    bool wild_ok = node != 0 || level_len == 0 || level[0] != '$';
+
+    for (int16_t c = n->first_child; c >= 0; c = router.nodes[c].next_sibling) {
+        const router_node_t *child = &router.nodes[c];
+        bool single = child->level_len == 1 && child->level[0] == '+';
+        bool multi = child->level_len == 1 && child->level[0] == '#';
+        if (multi) {
+            if (wild_ok && child->filter >= 0) count = emit(child->filter, out, max, count);
+        } else if ((single && wild_ok) ||
+                   (child->level_len == level_len && memcmp(child->level, level, level_len) == 0)) {
+            count = trie_match(c, topic, len, next, out, max, count);
+        }
+    }
+    return count;
+}
+
+int topic_router_match(const char *topic, size_t topic_len, uint16_t *out, int max)
+{
+    if (router.num_filters == 0) {
+        return 0;
+    }
+
+    int count = 0;
+    uint32_t hash = hash_topic(topic, topic_len);
+    for (uint32_t i = hash & router.bucket_mask; router.buckets[i].filter >= 0; i = (i + 1) & router.bucket_mask) {
+        const router_filter_t *f = &router.filters[router.buckets[i].filter];
+        if (router.buckets[i].hash == hash && f->len == topic_len && memcmp(f->text, topic, topic_len) == 0) {
+            count = emit(router.buckets[i].filter, out, max, count);
+            break;
+        }
+    }
+
+    if (router.nodes[0].first_child >= 0) {
+        count = trie_match(0, topic, topic_len, 0, out, max, count);
+    }
+    return count;
+}
+
+int topic_router_filter_count(void)
+{
+    return router.num_filters;
+}
+
+const char *topic_router_filter(int index)
+{
+    return (index >= 0 && index < router.num_filters) ? router.filters[index].text : NULL;
+}
+
+int topic_router_filter_qos(int index)
+{
+    return (index >= 0 && index < router.num_filters) ? router.filters[index].qos : 0;
+}
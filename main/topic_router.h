@@ -0,0 +1,46 @@
+#ifndef TOPIC_ROUTER_H
+#define TOPIC_ROUTER_H
+
+#include "config_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TOPIC_ROUTER_MAX_FANOUT 32
+
+// Topic-to-widget routing index, built at config load. Exact topics are
+// looked up in a hash map, filters with MQTT wildcards ('+', '#') in a trie
+// of topic levels. Several widgets may share one topic or filter. The batch
+// topic (mqtt.batch_topic) routes to the index one past the last widget.
+
+bool topic_router_build(const app_config_t *config);
+
+// True if filter is a well-formed MQTT topic filter: not empty, '+' and '#'
+// only ever fill a whole level and '#' is the last level. The router skips
+// malformed filters, so config load rejects them first to say why.
+bool topic_router_filter_valid(const char *filter);
+
+// True if some topic matches both valid filters a and b
+bool topic_router_filters_overlap(const char *a, const char *b);
+
+#define TOPIC_ROUTER_BATCH_QOS 1
+
+// Write the indices of the widgets interested in topic to out (at most max)
+// and return how many matched in total. topic need not be NUL-terminated.
+int topic_router_match(const char *topic, size_t topic_len, uint16_t *out, int max);
+
+// Deduplicated subscription set derived from the same index, each filter
+// with the highest QoS any of its widgets asks for
+int topic_router_filter_count(void);
+const char *topic_router_filter(int index);
+int topic_router_filter_qos(int index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TOPIC_ROUTER_H
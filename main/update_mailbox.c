@@ -0,0 +1,119 @@
+#include "update_mailbox.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "MAILBOX";
+
+typedef struct {
+    char *data;
+    size_t size;
+    size_t len;
+    bool dirty;
+    int64_t first_post_us;
+    uint32_t posts;
+    uint8_t format;
+} mailbox_slot_t;
+
+static mailbox_slot_t *slots;
+static int num_slots;
+static TaskHandle_t consumer;
+// Held only for a bounded memcpy, never across parsing or rendering
+static portMUX_TYPE mailbox_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static size_t slot_size(const size_t *sizes, int slot)
+{
+    if (!sizes) return UPDATE_MAILBOX_SLOT_SIZE;
+    return sizes[slot] < UPDATE_MAILBOX_MAX_SLOT_SIZE ? sizes[slot] : UPDATE_MAILBOX_MAX_SLOT_SIZE;
+}
+
+bool update_mailbox_init(int count, const size_t *sizes)
+{
+    free(slots);
+    slots = NULL;
+    num_slots = 0;
+    if (count <= 0) {
+        return true;
+    }
+
+    // Slot headers followed by their payload buffers, in one block
+    size_t bytes = (size_t)count * sizeof(mailbox_slot_t);
+    for (int i = 0; i < count; i++) {
+        bytes += slot_size(sizes, i);
+    }
+    slots = (mailbox_slot_t *)calloc(1, bytes);
+    if (!slots) {
+        ESP_LOGE(TAG, "Failed to allocate %d mailbox slots", count);
+        return false;
+    }
+    char *data = (char *)(slots + count);
+    for (int i = 0; i < count; i++) {
+        slots[i].data = data;
+        slots[i].size = slot_size(sizes, i);
+        data += slots[i].size;
+    }
+    num_slots = count;
+    ESP_LOGI(TAG, "%d mailbox slots, %u bytes", count, (unsigned)bytes);
+    return true;
+}
+
+void update_mailbox_set_consumer(TaskHandle_t task)
+{
+    consumer = task;
+}
+
+int update_mailbox_slots(void)
+{
+    return num_slots;
+}
+
+bool update_mailbox_post(int slot, const char *data, size_t len, uint8_t format)
+{
+    if (slot < 0 || slot >= num_slots) {
+        return false;
+    }
+    if (len > slots[slot].size) {
+        ESP_LOGW(TAG, "Dropping %u byte payload for slot %d", (unsigned)len, slot);
+        return false;
+    }
+
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&mailbox_lock);
+    memcpy(slots[slot].data, data, len);
+    slots[slot].len = len;
+    slots[slot].format = format;
+    if (!slots[slot].dirty) {
+        slots[slot].first_post_us = now;
+        slots[slot].posts = 0;
+    }
+    slots[slot].posts++;
+    slots[slot].dirty = true;
+    taskEXIT_CRITICAL(&mailbox_lock);
+
+    if (consumer) {
+        xTaskNotifyGive(consumer);
+    }
+    return true;
+}
+
+bool update_mailbox_take(int slot, char *out, size_t out_size, update_mailbox_info_t *info)
+{
+    if (slot < 0 || slot >= num_slots || !slots[slot].dirty) {
+        return false;
+    }
+
+    bool taken = false;
+    taskENTER_CRITICAL(&mailbox_lock);
+    if (slots[slot].dirty && slots[slot].len <= out_size) {
+        memcpy(out, slots[slot].data, slots[slot].len);
+        info->len = slots[slot].len;
+        info->first_post_us = slots[slot].first_post_us;
+        info->posts = slots[slot].posts;
+        info->format = slots[slot].format;
+        slots[slot].dirty = false;
+        taken = true;
+    }
+    taskEXIT_CRITICAL(&mailbox_lock);
+    return taken;
+}
@@ -0,0 +1,49 @@
+#ifndef UPDATE_MAILBOX_H
+#define UPDATE_MAILBOX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UPDATE_MAILBOX_SLOT_SIZE 1024
+// Largest slot, for widgets whose payloads are bigger than the default
+#define UPDATE_MAILBOX_MAX_SLOT_SIZE 4096
+
+// Latest-value-wins mailbox between the network side and the render task,
+// one slot per widget. Posting overwrites the slot's payload and marks it
+// dirty without ever waiting on the consumer; the consumer drains all dirty
+// slots at once, so a burst of updates collapses into a single frame.
+
+// What happened to a slot since it was last taken
+typedef struct {
+    size_t len;
+    int64_t first_post_us;  // arrival of the oldest update not yet rendered
+    uint32_t posts;         // updates folded into this one
+    uint8_t format;         // as posted with the payload
+} update_mailbox_info_t;
+
+// sizes gives each slot's capacity (at most UPDATE_MAILBOX_MAX_SLOT_SIZE),
+// NULL sizes every slot UPDATE_MAILBOX_SLOT_SIZE
+bool update_mailbox_init(int num_slots, const size_t *sizes);
+// Task notified (xTaskNotifyGive) whenever a slot becomes dirty
+void update_mailbox_set_consumer(TaskHandle_t task);
+int update_mailbox_slots(void);
+
+// format travels with the payload (the widgets' payload encoding). Returns
+// false if the slot is unknown or the payload does not fit.
+bool update_mailbox_post(int slot, const char *data, size_t len, uint8_t format);
+
+// Copy out a dirty slot's payload and mark it clean, false if it was clean
+bool update_mailbox_take(int slot, char *out, size_t out_size, update_mailbox_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UPDATE_MAILBOX_H
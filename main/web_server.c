@@ -1,4 +1,12 @@
 #include "web_server.h"
+#include "display_manager.hpp"
+#include "app_mqtt.h"
+#include "alloc_probe.h"
+#include "histlog.h"
+#include "page_cache.h"
+#include "bitmap_cache.h"
+#include "snapshot.h"
+#include "cJSON.h"
 #include <esp_http_server.h>
 #include "esp_log.h"
 #include "esp_spiffs.h"
@@ -12,6 +20,7 @@
 #include "esp_mac.h"
 #include "esp_chip_info.h"
 #include "esp_flash.h"
+#include "esp_heap_caps.h"
 
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -121,6 +130,113 @@ static esp_err_t reboot_post_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+static void add_hist(cJSON *obj, const char *name, const uint32_t *hist, int buckets)
+{
+    cJSON *arr = cJSON_AddArrayToObject(obj, name);
+    for (int i = 0; i < buckets; i++) {
+        cJSON_AddItemToArray(arr, cJSON_CreateNumber(hist[i]));
+    }
+}
+
+static esp_err_t stats_get_handler(httpd_req_t *req)
+{
+    display_stats_t stats;
+    display_get_stats(&stats);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "updates_applied", stats.updates_applied);
+    cJSON_AddNumberToObject(root, "updates_suppressed", stats.updates_suppressed);
+    cJSON_AddNumberToObject(root, "refreshes", stats.refreshes);
+    add_hist(root, "updates_per_refresh", stats.updates_per_refresh, DISPLAY_HIST_BUCKETS);
+    add_hist(root, "latency_ms", stats.latency_ms, DISPLAY_HIST_BUCKETS);
+    cJSON_AddNumberToObject(root, "page_flips", stats.page_flips);
+    cJSON_AddNumberToObject(root, "page_cache_hits", stats.page_cache_hits);
+    cJSON_AddNumberToObject(root, "last_flip_ms", stats.last_flip_ms);
+    add_hist(root, "flip_ms", stats.flip_ms, DISPLAY_HIST_BUCKETS);
+
+    cJSON *startup = cJSON_AddObjectToObject(root, "startup");
+    cJSON_AddNumberToObject(startup, "first_frame_ms", stats.startup_ms);
+    cJSON_AddNumberToObject(startup, "updates", stats.startup_updates);
+    cJSON_AddBoolToObject(startup, "timed_out", stats.startup_timed_out != 0);
+
+    page_cache_stats_t pages;
+    page_cache_get_stats(&pages);
+    cJSON *cache = cJSON_AddObjectToObject(root, "page_cache");
+    cJSON_AddNumberToObject(cache, "hits", pages.hits);
+    cJSON_AddNumberToObject(cache, "misses", pages.misses);
+    cJSON_AddNumberToObject(cache, "stores", pages.stores);
+    cJSON_AddNumberToObject(cache, "bytes_used", pages.bytes_used);
+
+    bitmap_cache_stats_t cells;
+    bitmap_cache_get_stats(&cells);
+    cJSON *cell_cache = cJSON_AddObjectToObject(root, "bitmap_cache");
+    cJSON_AddNumberToObject(cell_cache, "hits", cells.hits);
+    cJSON_AddNumberToObject(cell_cache, "misses", cells.misses);
+    cJSON_AddNumberToObject(cell_cache, "inserts", cells.inserts);
+    cJSON_AddNumberToObject(cell_cache, "evictions", cells.evictions);
+    cJSON_AddNumberToObject(cell_cache, "compactions", cells.compactions);
+    cJSON_AddNumberToObject(cell_cache, "entries", cells.entries);
+    cJSON_AddNumberToObject(cell_cache, "bytes_used", cells.bytes_used);
+    cJSON_AddNumberToObject(cell_cache, "budget", cells.budget);
+
+    mqtt_stats_t mqtt;
+    mqtt_app_get_stats(&mqtt);
+    cJSON *messages = cJSON_AddObjectToObject(root, "mqtt");
+    cJSON_AddNumberToObject(messages, "messages", mqtt.messages);
+    cJSON_AddNumberToObject(messages, "bytes", mqtt.bytes);
+    cJSON_AddNumberToObject(messages, "reassembled", mqtt.reassembled);
+    cJSON_AddNumberToObject(messages, "oversize", mqtt.oversize);
+    cJSON_AddNumberToObject(messages, "unsupported", mqtt.unsupported);
+    cJSON_AddNumberToObject(messages, "reassembly_errors", mqtt.reassembly_errors);
+    cJSON_AddNumberToObject(messages, "payloads_dropped", stats.payloads_dropped);
+    cJSON_AddNumberToObject(messages, "batches", stats.batches);
+    cJSON_AddNumberToObject(messages, "batches_rejected", stats.batches_rejected);
+    cJSON_AddNumberToObject(messages, "subscribe_packets", mqtt.subscribe_packets);
+    cJSON_AddNumberToObject(messages, "resubscribes_skipped", mqtt.resubscribes_skipped);
+    // Both should stay 0: the path from the MQTT event to the widget store does not allocate
+    cJSON_AddNumberToObject(messages, "mqtt_allocs", alloc_probe_count(ALLOC_PROBE_MQTT));
+    cJSON_AddNumberToObject(messages, "parse_allocs", alloc_probe_count(ALLOC_PROBE_PARSE));
+
+    // Free and largest block together show heap fragmentation
+    cJSON *heap = cJSON_AddObjectToObject(root, "heap");
+    cJSON_AddNumberToObject(heap, "free", esp_get_free_heap_size());
+    cJSON_AddNumberToObject(heap, "min_free", esp_get_minimum_free_heap_size());
+    cJSON_AddNumberToObject(heap, "largest_block", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    histlog_stats_t log;
+    histlog_get_stats(&log);
+    cJSON *history = cJSON_AddObjectToObject(root, "history_log");
+    cJSON_AddNumberToObject(history, "appended", log.appended);
+    cJSON_AddNumberToObject(history, "pages_written", log.pages_written);
+    cJSON_AddNumberToObject(history, "segments_erased", log.segments_erased);
+    cJSON_AddNumberToObject(history, "pages_corrupt", log.pages_corrupt);
+    cJSON_AddNumberToObject(history, "write_errors", log.write_errors);
+    cJSON_AddNumberToObject(history, "compactions", log.compactions);
+    cJSON_AddNumberToObject(history, "records_compacted", log.records_compacted);
+
+    snapshot_stats_t snap;
+    snapshot_get_stats(&snap);
+    cJSON *snapshot = cJSON_AddObjectToObject(root, "snapshot");
+    cJSON_AddNumberToObject(snapshot, "restore_ms", stats.restore_ms);
+    cJSON_AddNumberToObject(snapshot, "saves", snap.saves);
+    cJSON_AddNumberToObject(snapshot, "unchanged", snap.unchanged);
+    cJSON_AddNumberToObject(snapshot, "sectors_erased", snap.sectors_erased);
+    cJSON_AddNumberToObject(snapshot, "write_errors", snap.write_errors);
+    cJSON_AddNumberToObject(snapshot, "corrupt", snap.corrupt);
+    cJSON_AddNumberToObject(snapshot, "last_bytes", snap.last_bytes);
+
+    char *json = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+    if (!json) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+    free(json);
+    return ESP_OK;
+}
+
 void start_web_server(void)
 {
     httpd_handle_t server = NULL;
@@ -153,4 +269,11 @@ void start_web_server(void)
         .handler   = reboot_post_handler,
     };
     httpd_register_uri_handler(server, &reboot_uri);
+
+    httpd_uri_t stats_uri = {
+        .uri       = "/stats",
+        .method    = HTTP_GET,
+        .handler   = stats_get_handler,
+    };
+    httpd_register_uri_handler(server, &stats_uri);
 }
\ No newline at end of file
@@ -27,7 +27,8 @@ typedef struct {
     uint32_t timestamp;
 } list_widget_data_t;
 
-// Union type for different widget data types
+// Union type for different widget data types. Widget state only allocates
+// the member of its own type, so never copy a stored widget_data_t whole.
 typedef union {
     info_card_data_t info_card;
     weather_card_data_t weather_card;
@@ -0,0 +1,50 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Shared helpers for the host benchmarks. Every benchmark checks its own
+// results and exits non-zero on a mismatch; with --quick (as run by ctest)
+// it does a single short round, only to check.
+
+static inline int64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline bool bench_quick(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) return true;
+    }
+    return false;
+}
+
+#define BENCH_CHECK(cond)                                                     \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                          \
+        }                                                                     \
+    } while (0)
+
+// Best of rounds: the time of one call of body, in ns
+#define BENCH_BEST_NS(result, rounds, iters, body)                            \
+    do {                                                                      \
+        (result) = 1e18;                                                      \
+        for (int bench_r = 0; bench_r < (rounds); bench_r++) {                \
+            int64_t bench_t0 = bench_now_ns();                                \
+            for (long bench_i = 0; bench_i < (iters); bench_i++) { body; }    \
+            double bench_ns = (double)(bench_now_ns() - bench_t0) / (double)(iters); \
+            if (bench_ns < (result)) (result) = bench_ns;                     \
+        }                                                                     \
+    } while (0)
+
+#endif // BENCH_H
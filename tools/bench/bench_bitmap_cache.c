@@ -0,0 +1,154 @@
+// Widget cell cache over a synthetic MQTT trace, shaped like a home
+// dashboard: temperatures rounded to 0.1 drifting around a set point,
+// integer humidities, power readings that rarely repeat and a few status
+// topics with a handful of states. Each update re-renders its widget's cell:
+// a lookup, and on a miss an insert of the freshly drawn bits. Reports hit
+// rate, pool compactions and cache cost per update for several budgets, and
+// checks that no update touches the heap once the cache is set up.
+//
+// The trace is generated rather than recorded: no broker capture of a real
+// dashboard is available to check in.
+#include "bench.h"
+#include "bitmap_cache.h"
+#include "canvas.h"
+
+#define NUM_WIDGETS 16
+#define TRACE_LEN 20000
+
+typedef struct {
+    const char *name;
+    int kind;       // 0 temperature, 1 humidity, 2 power, 3 status
+    int w, h;       // cell size in pixels, from the 12x8 grid on 800x480
+    double level;
+    double base;    // where level is pulled back to
+} widget_t;
+
+typedef struct {
+    uint8_t widget;
+    char value[16];
+} update_t;
+
+static widget_t widgets[NUM_WIDGETS] = {
+    { "living_temp", 0, 132, 120, 21.0 }, { "kitchen_temp", 0, 132, 120, 20.5 },
+    { "bedroom_temp", 0, 132, 120, 18.5 }, { "bath_temp", 0, 132, 120, 22.0 },
+    { "office_temp", 0, 132, 120, 21.5 }, { "outside_temp", 0, 198, 120, 9.0 },
+    { "living_hum", 1, 132, 60, 45 }, { "kitchen_hum", 1, 132, 60, 50 },
+    { "bath_hum", 1, 132, 60, 60 }, { "outside_hum", 1, 132, 60, 80 },
+    { "house_power", 2, 198, 120, 450 }, { "solar_power", 2, 198, 120, 1200 },
+    { "heatpump_power", 2, 198, 120, 800 }, { "front_door", 3, 132, 60, 0 },
+    { "garage", 3, 132, 60, 0 }, { "washer", 3, 132, 60, 0 },
+};
+
+static update_t trace[TRACE_LEN];
+
+static void make_trace(void)
+{
+    static const char *states[] = { "closed", "open", "idle", "running", "done" };
+    srand(7);
+    for (int w = 0; w < NUM_WIDGETS; w++) {
+        widgets[w].base = widgets[w].level;
+    }
+    for (int i = 0; i < TRACE_LEN; i++) {
+        int w = rand() % NUM_WIDGETS;
+        widget_t *wd = &widgets[w];
+        trace[i].widget = (uint8_t)w;
+        switch (wd->kind) {
+            case 0:
+                // Random walk pulled back to where it started
+                wd->level += (rand() % 5 - 2) * 0.1 + (wd->base - wd->level) * 0.2;
+                snprintf(trace[i].value, sizeof(trace[i].value), "%.1f", wd->level);
+                break;
+            case 1:
+                wd->level += rand() % 3 - 1 + (wd->base - wd->level) * 0.2;
+                snprintf(trace[i].value, sizeof(trace[i].value), "%.0f", wd->level);
+                break;
+            case 2:
+                snprintf(trace[i].value, sizeof(trace[i].value), "%d", (int)wd->level + rand() % 400 - 200);
+                break;
+            default:
+                snprintf(trace[i].value, sizeof(trace[i].value), "%s", states[rand() % 3 + (w == 15 ? 2 : 0)]);
+                break;
+        }
+    }
+}
+
+// Key as the display builds it: type, name, cell size, what is shown
+static uint64_t cell_key(const widget_t *wd, const char *value)
+{
+    uint64_t key = bitmap_cache_hash(BITMAP_CACHE_HASH_SEED, &wd->kind, sizeof(wd->kind));
+    key = bitmap_cache_hash_str(key, wd->name);
+    key = bitmap_cache_hash(key, &wd->w, sizeof(wd->w));
+    key = bitmap_cache_hash(key, &wd->h, sizeof(wd->h));
+    return bitmap_cache_hash_str(key, value);
+}
+
+static void draw(uint8_t *bits, size_t size, uint64_t key)
+{
+    for (size_t i = 0; i < size; i++) {
+        bits[i] = (uint8_t)(key >> (8 * (i % 8)));
+    }
+}
+
+// Heap calls, counted by wrapping malloc and free at link time
+static long heap_calls;
+
+void *__real_malloc(size_t size);
+void __real_free(void *p);
+
+void *__wrap_malloc(size_t size)
+{
+    heap_calls++;
+    return __real_malloc(size);
+}
+
+void __wrap_free(void *p)
+{
+    if (p) heap_calls++;
+    __real_free(p);
+}
+
+static void replay(void)
+{
+    for (int i = 0; i < TRACE_LEN; i++) {
+        const widget_t *wd = &widgets[trace[i].widget];
+        uint64_t key = cell_key(wd, trace[i].value);
+        size_t size = canvas_rect_size(wd->w, wd->h);
+        const uint8_t *hit = bitmap_cache_lookup(key, wd->w, wd->h);
+        if (hit) {
+            // A hit must hand back exactly what was drawn for that content
+            BENCH_CHECK(hit[0] == (uint8_t)key && hit[size - 1] == (uint8_t)(key >> (8 * ((size - 1) % 8))));
+            continue;
+        }
+        uint8_t *slot = bitmap_cache_insert(key, wd->w, wd->h);
+        if (slot) draw(slot, size, key);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = bench_quick(argc, argv);
+    make_trace();
+    static const int budgets_kb[] = { 8, 16, 32, 64, 128 };
+    printf("%d updates over %d widgets, cells of 1-3 KB\n", TRACE_LEN, NUM_WIDGETS);
+    for (size_t b = 0; b < sizeof(budgets_kb) / sizeof(budgets_kb[0]); b++) {
+        double ns;
+        bitmap_cache_stats_t stats;
+        long calls = 0;
+        BENCH_BEST_NS(ns, quick ? 1 : 5, 1, {
+            bitmap_cache_init((size_t)budgets_kb[b] * 1024);
+            calls = heap_calls;
+            replay();
+            calls = heap_calls - calls;
+            bitmap_cache_get_stats(&stats);
+        });
+        BENCH_CHECK(stats.budget == (size_t)budgets_kb[b] * 1024);
+        BENCH_CHECK(stats.hits + stats.misses == TRACE_LEN);
+        BENCH_CHECK(stats.bytes_used <= stats.budget);
+        BENCH_CHECK(calls == 0);
+        printf("  %3d KB: hit rate %5.1f%%  inserts %5u  evictions %5u  compactions %4u  %4.0f ns/update\n",
+               budgets_kb[b], 100.0 * stats.hits / TRACE_LEN, (unsigned)stats.inserts, (unsigned)stats.evictions,
+               (unsigned)stats.compactions, ns / TRACE_LEN);
+    }
+    bitmap_cache_init(0);
+    return 0;
+}
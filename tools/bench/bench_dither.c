@@ -0,0 +1,73 @@
+// Dither throughput over a full panel frame, per mode, in megapixels per
+// second. The source is a horizontal gradient with noise, pushed one row at
+// a time the way the display pushes decoded images.
+#include "bench.h"
+#include "canvas.h"
+#include "dither.h"
+
+#define PANEL_W 800
+#define PANEL_H 480
+
+static uint8_t framebuffer[PANEL_W / 8 * PANEL_H];
+static uint8_t gray[PANEL_H][PANEL_W];
+
+static void dither_frame(canvas_t *canvas, dither_mode_t mode, void *scratch)
+{
+    dither_t d;
+    BENCH_CHECK(dither_begin(&d, canvas, 0, 0, PANEL_W, PANEL_H, mode, scratch));
+    for (int y = 0; y < PANEL_H; y++) {
+        dither_push_row(&d, gray[y]);
+    }
+    dither_end(&d);
+}
+
+static int black_pixels(void)
+{
+    int n = 0;
+    for (size_t i = 0; i < sizeof(framebuffer); i++) {
+        n += __builtin_popcount(framebuffer[i]);
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = bench_quick(argc, argv);
+    srand(1);
+    long sum = 0;
+    for (int y = 0; y < PANEL_H; y++) {
+        for (int x = 0; x < PANEL_W; x++) {
+            int v = x * 255 / (PANEL_W - 1) + rand() % 17 - 8;
+            gray[y][x] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+            sum += gray[y][x];
+        }
+    }
+    // Share of black the image should come out with
+    double want_black = 1.0 - (double)sum / (255.0 * PANEL_W * PANEL_H);
+
+    canvas_t canvas;
+    canvas_init(&canvas, framebuffer, PANEL_W, PANEL_H, true);
+    static const struct {
+        dither_mode_t mode;
+        const char *name;
+    } modes[] = {
+        { DITHER_THRESHOLD, "threshold" },
+        { DITHER_BAYER, "bayer" },
+        { DITHER_FLOYD_STEINBERG, "floyd_steinberg" },
+        { DITHER_ATKINSON, "atkinson" },
+    };
+    static uint8_t scratch[4 * (PANEL_W + 2) * sizeof(int16_t)];
+    BENCH_CHECK(dither_scratch_size(PANEL_W, DITHER_ATKINSON) <= sizeof(scratch));
+
+    printf("%dx%d frame, %s\n", PANEL_W, PANEL_H, quick ? "quick check" : "best of 5");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        double ns;
+        BENCH_BEST_NS(ns, quick ? 1 : 5, quick ? 1 : 20, dither_frame(&canvas, modes[m].mode, scratch));
+        double black = (double)black_pixels() / (PANEL_W * PANEL_H);
+        // Every mode preserves the mean tone, threshold only roughly
+        BENCH_CHECK(black > want_black - 0.05 && black < want_black + 0.05);
+        printf("  %-16s %7.1f MP/s  %5.2f ms/frame  black %.3f (want %.3f)\n", modes[m].name,
+               PANEL_W * PANEL_H / ns * 1e3, ns / 1e6, black, want_black);
+    }
+    return 0;
+}
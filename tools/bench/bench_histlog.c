@@ -0,0 +1,127 @@
+// History log on a file-backed partition the size of the device's (128 KB).
+// One fast widget reports every 10 s and three slow ones every 15, 30 and
+// 60 minutes, each keeping 240 samples, for 12 days: the fast widget alone
+// wraps the log ten times. Once with compaction driven the way the display
+// drives it and once without, the log is then remounted and replayed into
+// fresh rings. Reports the samples each widget gets back, replay time and
+// compaction cost.
+#include "bench.h"
+#include "histlog.h"
+#include "history.h"
+#include <math.h>
+
+#define LOG_SIZE (128 * 1024)
+#define NUM_WIDGETS 4
+#define CAPACITY 240
+#define STEP_S 10
+#define DAYS 12
+
+static const uint32_t periods[NUM_WIDGETS] = { 10, 900, 1800, 3600 };
+
+typedef struct {
+    history_t rings[NUM_WIDGETS];
+    history_sample_t storage[NUM_WIDGETS][CAPACITY];
+} rings_t;
+
+static history_point_t points[CAPACITY];
+static history_point_t expect[CAPACITY];
+
+static void rings_init(rings_t *r)
+{
+    for (int w = 0; w < NUM_WIDGETS; w++) {
+        history_init(&r->rings[w], r->storage[w], CAPACITY, 0.1f);
+    }
+}
+
+// As the display does it
+static void replay_record(const histlog_record_t *record, void *arg)
+{
+    history_t *h = &((rings_t *)arg)->rings[record->id];
+    if (h->count == 0 || record->t >= h->last_ts) {
+        history_push(h, record->t, record->value);
+    }
+}
+
+static void compact(const rings_t *r)
+{
+    BENCH_CHECK(histlog_compact_begin());
+    for (int w = 0; w < NUM_WIDGETS; w++) {
+        int n = history_decode(&r->rings[w], points);
+        for (int k = 0; k < n; k++) histlog_compact_add((uint32_t)w, points[k].t, points[k].v);
+    }
+    BENCH_CHECK(histlog_compact_end());
+}
+
+static void run(const char *path, bool compaction, int days)
+{
+    static rings_t live, restored;
+    histlog_flash_t flash;
+    remove(path);
+    BENCH_CHECK(histlog_flash_file(&flash, path, LOG_SIZE));
+    BENCH_CHECK(histlog_mount(&flash));
+    rings_init(&live);
+
+    // The rings fit in one compaction run with room to spare
+    BENCH_CHECK(NUM_WIDGETS * CAPACITY <= histlog_compact_limit());
+
+    int64_t compact_ns = 0;
+    for (uint32_t t = STEP_S; t <= (uint32_t)days * 86400; t += STEP_S) {
+        // Appends only flag compaction; it runs once the step's updates are in
+        bool pending = false;
+        for (int w = 0; w < NUM_WIDGETS; w++) {
+            if (t % periods[w] != 0) continue;
+            float v = roundf((20.0f + 5.0f * sinf((float)t / (3000.0f * (w + 1)))) * 10.0f) / 10.0f;
+            history_push(&live.rings[w], t, v);
+            histlog_append((uint32_t)w, t, v);
+            if (histlog_compaction_due()) pending = true;
+        }
+        if (compaction && pending) {
+            int64_t t0 = bench_now_ns();
+            compact(&live);
+            compact_ns += bench_now_ns() - t0;
+        }
+    }
+    histlog_flush();
+    histlog_stats_t stats;
+    histlog_get_stats(&stats);
+
+    // Reboot: mount and replay, timed
+    rings_init(&restored);
+    int64_t t0 = bench_now_ns();
+    BENCH_CHECK(histlog_mount(&flash));
+    int replayed = histlog_replay(NUM_WIDGETS * CAPACITY, replay_record, &restored);
+    double replay_ms = (double)(bench_now_ns() - t0) / 1e6;
+    fclose((FILE *)flash.ctx);
+    remove(path);
+
+    printf("%s compaction: %u appended, %u segments erased, %u compactions of %.0f records in %.2f ms each\n",
+           compaction ? "with" : "without", (unsigned)stats.appended, (unsigned)stats.segments_erased,
+           (unsigned)stats.compactions, stats.compactions ? (double)stats.records_compacted / stats.compactions : 0.0,
+           stats.compactions ? (double)compact_ns / 1e6 / stats.compactions : 0.0);
+    printf("  replayed %d records in %.2f ms, samples restored:", replayed, replay_ms);
+    for (int w = 0; w < NUM_WIDGETS; w++) {
+        printf(" %u/%u", restored.rings[w].count, live.rings[w].count);
+    }
+    printf("\n");
+
+    // With compaction every ring comes back as it was
+    if (compaction) {
+        for (int w = 0; w < NUM_WIDGETS; w++) {
+            int n = history_decode(&live.rings[w], expect);
+            BENCH_CHECK(history_decode(&restored.rings[w], points) == n);
+            for (int k = 0; k < n; k++) {
+                BENCH_CHECK(points[k].t == expect[k].t && fabsf(points[k].v - expect[k].v) < 1e-3f);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // Two days still wraps the log twice and compacts twice
+    int days = bench_quick(argc, argv) ? 2 : DAYS;
+    const char *path = "bench_histlog.bin";
+    run(path, false, days);
+    run(path, true, days);
+    return 0;
+}
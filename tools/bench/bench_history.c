@@ -0,0 +1,87 @@
+// Widget history rings: storage per sample, push cost, and the decode and
+// LTTB reduction a sparkline does on every redraw, for a 240-sample ring
+// drawn into a 120-column cell. Also checks that quantised values stay
+// within half a resolution step, also for a meter total that drifts far past
+// the 16-bit step range, and that LTTB keeps both ends and the spike.
+#include "bench.h"
+#include "history.h"
+#include <math.h>
+
+#define CAPACITY 240
+#define COLUMNS 120
+
+static history_sample_t storage[CAPACITY];
+static history_point_t points[CAPACITY];
+static history_point_t reduced[CAPACITY];
+
+static float sample(int i)
+{
+    // Daily temperature swing with a spike two thirds of the way in
+    return 20.0f + 4.0f * sinf((float)i / 40.0f) + (i == 2 * CAPACITY / 3 ? 6.0f : 0.0f);
+}
+
+static float total(int i)
+{
+    // Energy meter total in kWh with three decimals, like Tasmota's
+    // ENERGY.Total, climbing 0.25 kWh a sample: 120000 steps over the run
+    return 1234.567f + 0.25f * (float)i;
+}
+
+// The decoded ring follows the meter instead of flat-lining at the edge of
+// the int16 step range
+static void check_drift(void)
+{
+    history_t h;
+    history_init(&h, storage, CAPACITY, 0.001f);
+    for (int i = 0; i < 2 * CAPACITY; i++) {
+        history_push(&h, (uint32_t)(i * 60), total(i));
+    }
+    BENCH_CHECK(history_decode(&h, points) == CAPACITY);
+    for (int i = 0; i < CAPACITY; i++) {
+        BENCH_CHECK(fabsf(points[i].v - total(CAPACITY + i)) <= 0.0005f + 1e-4f);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = bench_quick(argc, argv);
+    check_drift();
+
+    history_t h;
+    history_init(&h, storage, CAPACITY, 0.1f);
+    // Twice the capacity, so the ring has wrapped
+    for (int i = 0; i < 2 * CAPACITY; i++) {
+        history_push(&h, (uint32_t)(i * 60), sample(i - CAPACITY));
+    }
+
+    int n = history_decode(&h, points);
+    BENCH_CHECK(n == CAPACITY);
+    for (int i = 0; i < n; i++) {
+        BENCH_CHECK(points[i].t == (uint32_t)((CAPACITY + i) * 60));
+        BENCH_CHECK(fabsf(points[i].v - sample(i)) <= 0.05f + 1e-4f);
+    }
+
+    int m = history_lttb(points, n, reduced, COLUMNS);
+    BENCH_CHECK(m == COLUMNS);
+    BENCH_CHECK(reduced[0].t == points[0].t && reduced[m - 1].t == points[n - 1].t);
+    bool spike = false;
+    for (int i = 0; i < m; i++) {
+        if (reduced[i].t == points[2 * CAPACITY / 3].t) spike = true;
+        if (i > 0) BENCH_CHECK(reduced[i].t > reduced[i - 1].t);
+    }
+    BENCH_CHECK(spike);
+
+    long iters = quick ? 10 : 200000;
+    double push_ns, decode_ns, lttb_ns;
+    uint32_t t = (uint32_t)(2 * CAPACITY * 60);
+    BENCH_BEST_NS(push_ns, quick ? 1 : 5, iters * 10, history_push(&h, t += 60, 21.3f));
+    BENCH_BEST_NS(decode_ns, quick ? 1 : 5, iters, history_decode(&h, points));
+    BENCH_BEST_NS(lttb_ns, quick ? 1 : 5, iters, history_lttb(points, n, reduced, COLUMNS));
+
+    printf("%d samples, %zu bytes each (%zu for the ring), %s\n", CAPACITY, sizeof(history_sample_t),
+           history_storage_size(CAPACITY), quick ? "quick check" : "best of 5");
+    printf("  push          %8.1f ns\n", push_ns);
+    printf("  decode        %8.1f ns\n", decode_ns);
+    printf("  lttb to %3d   %8.1f ns\n", COLUMNS, lttb_ns);
+    return 0;
+}
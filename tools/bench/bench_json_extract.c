@@ -0,0 +1,262 @@
+// Widget payload extraction: json_extract against the cJSON DOM the widgets
+// used before, on recorded payloads of each widget type. Reports messages
+// per second and the peak heap one message takes. Heap is counted by
+// wrapping malloc and friends at link time, the way alloc_probe does on the
+// device.
+//
+// cJSON is not vendored: it comes from ESP-IDF's json component under
+// $IDF_PATH or from -DCJSON_DIR=<dir with cJSON.c>. Without it only the
+// extractor is measured.
+#include "bench.h"
+#include "json_extract.h"
+#include "widget_data.h"
+#include <malloc.h>
+#include <stddef.h>
+#ifdef BENCH_WITH_CJSON
+#include "cJSON.h"
+#endif
+
+static size_t heap_now, heap_peak;
+static long heap_calls;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void __real_free(void *p);
+
+static void *heap_track(void *p)
+{
+    if (p) {
+        heap_now += malloc_usable_size(p);
+        if (heap_now > heap_peak) heap_peak = heap_now;
+        heap_calls++;
+    }
+    return p;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    return heap_track(__real_malloc(size));
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    return heap_track(__real_calloc(n, size));
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    if (p) heap_now -= malloc_usable_size(p);
+    return heap_track(__real_realloc(p, size));
+}
+
+void __wrap_free(void *p)
+{
+    if (p) heap_now -= malloc_usable_size(p);
+    __real_free(p);
+}
+
+typedef enum { INFO, WEATHER, LIST, POWER } kind_t;
+
+typedef struct {
+    const char *name;
+    kind_t kind;
+    const char *json;
+} payload_t;
+
+// As published by the dashboard's sources, numbers sent as strings except
+// for the Tasmota plug, read through a value_path
+static const payload_t payloads[] = {
+    { "info", INFO, "{\"value\":\"21.5\",\"unit\":\"\\u00b0C\",\"timestamp\":1760861702}" },
+    { "weather", WEATHER,
+      "{\"value\":\"12\",\"unit\":\"\\u00b0C\",\"icon\":\"partly-cloudy\",\"wind\":\"14 km/h\",\"humidity\":\"81\","
+      "\"forecast\":[{\"day\":\"Mon\",\"hi\":\"14\",\"lo\":\"7\"},{\"day\":\"Tue\",\"hi\":\"11\",\"lo\":\"5\"}]}" },
+    { "list", LIST,
+      "{\"items\":[{\"label\":\"Living room\",\"value\":\"21.4 \\u00b0C\"},{\"label\":\"Kitchen\",\"value\":\"20.9 \\u00b0C\"},"
+      "{\"label\":\"Bedroom\",\"value\":\"18.2 \\u00b0C\"},{\"label\":\"Bathroom\",\"value\":\"22.6 \\u00b0C\"},"
+      "{\"label\":\"Office\",\"value\":\"21.0 \\u00b0C\"},{\"label\":\"Hallway\",\"value\":\"19.7 \\u00b0C\"},"
+      "{\"label\":\"Garage\",\"value\":\"11.3 \\u00b0C\"},{\"label\":\"Attic\",\"value\":\"15.8 \\u00b0C\"},"
+      "{\"label\":\"Cellar\",\"value\":\"13.1 \\u00b0C\"},{\"label\":\"Outside\",\"value\":\"9.4 \\u00b0C\"}]}" },
+    { "power", POWER,
+      "{\"Time\":\"2026-10-19T08:15:02\",\"ENERGY\":{\"TotalStartTime\":\"2026-01-02T10:00:00\",\"Total\":1234.567,"
+      "\"Yesterday\":3.21,\"Today\":1.08,\"Power\":482,\"ApparentPower\":511,\"ReactivePower\":168,\"Factor\":0.94,"
+      "\"Voltage\":229,\"Current\":2.226}}" },
+};
+#define NUM_PAYLOADS (sizeof(payloads) / sizeof(payloads[0]))
+
+#define LIST_ITEM(member) offsetof(list_widget_data_t, items) + offsetof(list_item_t, member)
+
+static const json_field_t info_fields[] = {
+    { "value", JSON_FIELD_STRING, offsetof(info_card_data_t, value), 64 },
+    { "unit", JSON_FIELD_STRING, offsetof(info_card_data_t, unit), 16 },
+};
+static const json_field_t weather_fields[] = {
+    { "value", JSON_FIELD_STRING, offsetof(weather_card_data_t, value), 64 },
+    { "unit", JSON_FIELD_STRING, offsetof(weather_card_data_t, unit), 16 },
+    { "icon", JSON_FIELD_STRING, offsetof(weather_card_data_t, icon), 32 },
+};
+static const json_field_t list_fields[] = {
+    { "items[]", JSON_FIELD_COUNT, offsetof(list_widget_data_t, num_items), 0, 0, 10 },
+    { "items[].label", JSON_FIELD_STRING, LIST_ITEM(label), 32, sizeof(list_item_t), 10 },
+    { "items[].value", JSON_FIELD_STRING, LIST_ITEM(value), 64, sizeof(list_item_t), 10 },
+};
+static const json_field_t power_fields[] = {
+    { "$.ENERGY.Power", JSON_FIELD_SCALAR, offsetof(info_card_data_t, value), 64 },
+};
+
+static json_program_t programs[4];
+
+static void compile(kind_t kind, const json_field_t *fields, int n)
+{
+    json_program_init(&programs[kind]);
+    for (int i = 0; i < n; i++) {
+        BENCH_CHECK(json_program_add(&programs[kind], &fields[i]));
+    }
+}
+
+static bool extract(const payload_t *p, widget_data_t *out, uint32_t *changed)
+{
+    return json_extract(p->json, strlen(p->json), &programs[p->kind], out, changed);
+}
+
+#ifdef BENCH_WITH_CJSON
+static void copy_string(char *dst, size_t size, const cJSON *item)
+{
+    if (cJSON_IsString(item)) strncpy(dst, item->valuestring, size - 1);
+}
+
+// What the widgets did before json_extract: parse the whole payload into a
+// tree, look up the few keys they show, free the tree
+static bool parse_cjson(const payload_t *p, widget_data_t *out)
+{
+    cJSON *root = cJSON_Parse(p->json);
+    if (!root) return false;
+    switch (p->kind) {
+        case INFO:
+            copy_string(out->info_card.value, sizeof(out->info_card.value), cJSON_GetObjectItem(root, "value"));
+            copy_string(out->info_card.unit, sizeof(out->info_card.unit), cJSON_GetObjectItem(root, "unit"));
+            break;
+        case WEATHER:
+            copy_string(out->weather_card.value, sizeof(out->weather_card.value), cJSON_GetObjectItem(root, "value"));
+            copy_string(out->weather_card.unit, sizeof(out->weather_card.unit), cJSON_GetObjectItem(root, "unit"));
+            copy_string(out->weather_card.icon, sizeof(out->weather_card.icon), cJSON_GetObjectItem(root, "icon"));
+            break;
+        case LIST: {
+            cJSON *items = cJSON_GetObjectItem(root, "items");
+            int n = cJSON_GetArraySize(items);
+            out->list_widget.num_items = n > 10 ? 10 : n;
+            for (int i = 0; i < out->list_widget.num_items; i++) {
+                cJSON *item = cJSON_GetArrayItem(items, i);
+                copy_string(out->list_widget.items[i].label, sizeof(out->list_widget.items[i].label),
+                            cJSON_GetObjectItem(item, "label"));
+                copy_string(out->list_widget.items[i].value, sizeof(out->list_widget.items[i].value),
+                            cJSON_GetObjectItem(item, "value"));
+            }
+            break;
+        }
+        case POWER: {
+            cJSON *power = cJSON_GetObjectItem(cJSON_GetObjectItem(root, "ENERGY"), "Power");
+            if (cJSON_IsNumber(power)) {
+                snprintf(out->info_card.value, sizeof(out->info_card.value), "%g", power->valuedouble);
+            }
+            break;
+        }
+    }
+    cJSON_Delete(root);
+    return true;
+}
+#endif
+
+// Results every payload must extract to
+static void check_payloads(void)
+{
+    widget_data_t d;
+    uint32_t changed;
+
+    memset(&d, 0, sizeof(d));
+    BENCH_CHECK(extract(&payloads[INFO], &d, &changed) && changed == 3);
+    BENCH_CHECK(strcmp(d.info_card.value, "21.5") == 0 && strcmp(d.info_card.unit, "\xc2\xb0" "C") == 0);
+    // The same payload again changes nothing
+    BENCH_CHECK(extract(&payloads[INFO], &d, &changed) && changed == 0);
+
+    memset(&d, 0, sizeof(d));
+    BENCH_CHECK(extract(&payloads[WEATHER], &d, &changed) && changed == 7);
+    BENCH_CHECK(strcmp(d.weather_card.icon, "partly-cloudy") == 0);
+
+    memset(&d, 0, sizeof(d));
+    BENCH_CHECK(extract(&payloads[LIST], &d, &changed) && changed == 7 && d.list_widget.num_items == 10);
+    BENCH_CHECK(strcmp(d.list_widget.items[9].label, "Outside") == 0);
+    BENCH_CHECK(strcmp(d.list_widget.items[9].value, "9.4 \xc2\xb0" "C") == 0);
+
+    memset(&d, 0, sizeof(d));
+    BENCH_CHECK(extract(&payloads[POWER], &d, &changed) && changed == 1 && strcmp(d.info_card.value, "482") == 0);
+
+#ifdef BENCH_WITH_CJSON
+    // Both parsers fill in the same widget data
+    for (size_t i = 0; i < NUM_PAYLOADS; i++) {
+        widget_data_t a, b;
+        memset(&a, 0, sizeof(a));
+        memset(&b, 0, sizeof(b));
+        BENCH_CHECK(extract(&payloads[i], &a, &changed) && parse_cjson(&payloads[i], &b));
+        BENCH_CHECK(memcmp(&a, &b, sizeof(a)) == 0);
+    }
+#endif
+
+    // Malformed payloads are rejected
+    static const char *const bad[] = {
+        "{\"value\":\"x\"", "{\"value\" \"x\"}", "{\"value\":\"x\"} junk", "{\"value\":tru}",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        BENCH_CHECK(!json_extract(bad[i], strlen(bad[i]), &programs[INFO], &d, &changed));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = bench_quick(argc, argv);
+    compile(INFO, info_fields, 2);
+    compile(WEATHER, weather_fields, 3);
+    compile(LIST, list_fields, 3);
+    compile(POWER, power_fields, 1);
+    check_payloads();
+
+    long iters = quick ? 100 : 200000;
+    static widget_data_t out;
+    uint32_t changed;
+    printf("%s\n", quick ? "quick check" : "best of 5");
+    printf("  %-8s %5s  %14s %9s %7s", "payload", "bytes", "json_extract", "heap", "allocs");
+#ifdef BENCH_WITH_CJSON
+    printf("  %14s %9s %7s", "cJSON", "heap", "allocs");
+#endif
+    printf("\n");
+
+    for (size_t i = 0; i < NUM_PAYLOADS; i++) {
+        const payload_t *p = &payloads[i];
+        size_t base = heap_now;
+        heap_peak = heap_now;
+        long calls = heap_calls;
+        BENCH_CHECK(extract(p, &out, &changed));
+        size_t peak = heap_peak - base;
+        long allocs = heap_calls - calls;
+        BENCH_CHECK(peak == 0 && allocs == 0);
+        double ns;
+        BENCH_BEST_NS(ns, quick ? 1 : 5, iters, extract(p, &out, &changed));
+        printf("  %-8s %5zu  %8.0f msgs/s %7zu B %7ld", p->name, strlen(p->json), 1e9 / ns, peak, allocs);
+
+#ifdef BENCH_WITH_CJSON
+        heap_peak = heap_now;
+        calls = heap_calls;
+        BENCH_CHECK(parse_cjson(p, &out));
+        peak = heap_peak - base;
+        allocs = heap_calls - calls;
+        BENCH_CHECK(heap_now == base);
+        BENCH_BEST_NS(ns, quick ? 1 : 5, iters, parse_cjson(p, &out));
+        printf("  %8.0f msgs/s %7zu B %7ld", 1e9 / ns, peak, allocs);
+#endif
+        printf("\n");
+    }
+#ifndef BENCH_WITH_CJSON
+    printf("cJSON not found: set IDF_PATH or CJSON_DIR to compare against it\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,345 @@
+// Payload size and extraction time per encoding: JSON with numbers sent as
+// strings (what publishers send today), JSON with plain numbers, CBOR and
+// MessagePack with numbers, and CBOR with numbers sent as strings. The last
+// one isolates what turning binary numbers into the widget store's text
+// costs. Payloads are encoded here from one description, so every encoding
+// carries the same content.
+#include "bench.h"
+#include "json_extract.h"
+#include "widget_data.h"
+#include <math.h>
+#include <stddef.h>
+
+enum { JSON_STR, JSON_NUM, CBOR_NUM, CBOR_STR, MSGPACK_NUM, NUM_ENCODINGS };
+
+static const char *const encoding_names[NUM_ENCODINGS] = {
+    "JSON strings", "JSON numbers", "CBOR", "CBOR strings", "MessagePack",
+};
+static const payload_encoding_t encodings[NUM_ENCODINGS] = {
+    PAYLOAD_JSON, PAYLOAD_JSON, PAYLOAD_CBOR, PAYLOAD_CBOR, PAYLOAD_MSGPACK,
+};
+
+#define MAX_PAYLOAD 1024
+#define MAX_NESTING 8
+
+// Writes one payload in every encoding at once
+typedef struct {
+    uint8_t buf[NUM_ENCODINGS][MAX_PAYLOAD];
+    size_t len[NUM_ENCODINGS];
+    // JSON separators: items written at each open level, whether it is an object
+    int items[MAX_NESTING];
+    bool object[MAX_NESTING];
+    int depth;
+} writer_t;
+
+static void put(writer_t *w, int e, const void *data, size_t n)
+{
+    BENCH_CHECK(w->len[e] + n <= MAX_PAYLOAD);
+    memcpy(w->buf[e] + w->len[e], data, n);
+    w->len[e] += n;
+}
+
+static void put_byte(writer_t *w, int e, uint8_t b)
+{
+    put(w, e, &b, 1);
+}
+
+static void put_be(writer_t *w, int e, uint64_t v, int n)
+{
+    for (int i = n - 1; i >= 0; i--) put_byte(w, e, (uint8_t)(v >> (8 * i)));
+}
+
+static void cbor_head(writer_t *w, int e, int major, uint64_t arg)
+{
+    uint8_t m = (uint8_t)(major << 5);
+    if (arg < 24) {
+        put_byte(w, e, m | (uint8_t)arg);
+    } else if (arg <= 0xff) {
+        put_byte(w, e, m | 24);
+        put_be(w, e, arg, 1);
+    } else if (arg <= 0xffff) {
+        put_byte(w, e, m | 25);
+        put_be(w, e, arg, 2);
+    } else {
+        put_byte(w, e, m | 26);
+        put_be(w, e, arg, 4);
+    }
+}
+
+static void msgpack_head(writer_t *w, uint8_t fix, uint8_t fix_max, uint8_t op16, size_t n)
+{
+    if (n <= fix_max) {
+        put_byte(w, MSGPACK_NUM, (uint8_t)(fix | n));
+    } else {
+        put_byte(w, MSGPACK_NUM, op16);
+        put_be(w, MSGPACK_NUM, n, 2);
+    }
+}
+
+// Comma before a JSON item, and for an object member nothing else: the key
+// was written by w_key with its colon
+static void json_item(writer_t *w, bool is_key)
+{
+    int d = w->depth;
+    if (d == 0 || (w->object[d - 1] && !is_key)) return;
+    if (w->items[d - 1]++ > 0) {
+        put_byte(w, JSON_STR, ',');
+        put_byte(w, JSON_NUM, ',');
+    }
+}
+
+static void w_text(writer_t *w, const char *s, bool is_key)
+{
+    size_t n = strlen(s);
+    json_item(w, is_key);
+    for (int e = JSON_STR; e <= JSON_NUM; e++) {
+        put_byte(w, e, '"');
+        put(w, e, s, n);
+        put_byte(w, e, '"');
+        if (is_key) put_byte(w, e, ':');
+    }
+    cbor_head(w, CBOR_NUM, 3, n);
+    put(w, CBOR_NUM, s, n);
+    cbor_head(w, CBOR_STR, 3, n);
+    put(w, CBOR_STR, s, n);
+    if (n < 32) {
+        put_byte(w, MSGPACK_NUM, (uint8_t)(0xa0 | n));
+    } else {
+        put_byte(w, MSGPACK_NUM, 0xd9);
+        put_byte(w, MSGPACK_NUM, (uint8_t)n);
+    }
+    put(w, MSGPACK_NUM, s, n);
+}
+
+static void w_key(writer_t *w, const char *key)
+{
+    w_text(w, key, true);
+}
+
+static void w_string(writer_t *w, const char *s)
+{
+    w_text(w, s, false);
+}
+
+static void w_open(writer_t *w, bool object, int n)
+{
+    json_item(w, false);
+    put_byte(w, JSON_STR, object ? '{' : '[');
+    put_byte(w, JSON_NUM, object ? '{' : '[');
+    cbor_head(w, CBOR_NUM, object ? 5 : 4, (uint64_t)n);
+    cbor_head(w, CBOR_STR, object ? 5 : 4, (uint64_t)n);
+    msgpack_head(w, object ? 0x80 : 0x90, 15, object ? 0xde : 0xdc, (size_t)n);
+    BENCH_CHECK(w->depth < MAX_NESTING);
+    w->object[w->depth] = object;
+    w->items[w->depth++] = 0;
+}
+
+static void w_close(writer_t *w)
+{
+    bool object = w->object[--w->depth];
+    put_byte(w, JSON_STR, object ? '}' : ']');
+    put_byte(w, JSON_NUM, object ? '}' : ']');
+}
+
+// Half-precision bits of v if it has an exact normal half
+static bool half_bits(double v, uint16_t *bits)
+{
+    int exp;
+    double m = frexp(fabs(v), &exp) * 2048;
+    if (m != floor(m) || exp - 1 < -14 || exp - 1 > 15) return false;
+    *bits = (uint16_t)((v < 0 ? 0x8000 : 0) | (exp + 14) << 10 | ((int)m - 1024));
+    return true;
+}
+
+// A number given as the decimal text publishers send. Binary encodings use
+// the smallest type that reads back as the same decimal.
+static void w_number(writer_t *w, const char *text)
+{
+    size_t n = strlen(text);
+    json_item(w, false);
+    put_byte(w, JSON_STR, '"');
+    put(w, JSON_STR, text, n);
+    put_byte(w, JSON_STR, '"');
+    put(w, JSON_NUM, text, n);
+    cbor_head(w, CBOR_STR, 3, n);
+    put(w, CBOR_STR, text, n);
+
+    double v = strtod(text, NULL);
+    char back[32];
+    if (v == floor(v) && fabs(v) < 4294967296.0) {
+        uint64_t u = (uint64_t)fabs(v);
+        cbor_head(w, CBOR_NUM, v < 0 ? 1 : 0, v < 0 ? u - 1 : u);
+        if (v >= 0 && u < 128) {
+            put_byte(w, MSGPACK_NUM, (uint8_t)u);
+        } else if (v >= 0) {
+            put_byte(w, MSGPACK_NUM, 0xce);
+            put_be(w, MSGPACK_NUM, u, 4);
+        } else {
+            put_byte(w, MSGPACK_NUM, 0xd2);
+            put_be(w, MSGPACK_NUM, (uint32_t)(int32_t)v, 4);
+        }
+        return;
+    }
+    // Halves are exact, float and double only read back as the decimal
+    float f = (float)v;
+    snprintf(back, sizeof(back), "%.7g", f);
+    bool single = strtod(back, NULL) == v;
+    uint16_t half;
+    uint32_t bits32;
+    uint64_t bits64;
+    memcpy(&bits32, &f, sizeof(bits32));
+    memcpy(&bits64, &v, sizeof(bits64));
+    if (half_bits(v, &half)) {
+        put_byte(w, CBOR_NUM, 0xf9);
+        put_be(w, CBOR_NUM, half, 2);
+    } else if (single) {
+        put_byte(w, CBOR_NUM, 0xfa);
+        put_be(w, CBOR_NUM, bits32, 4);
+    } else {
+        put_byte(w, CBOR_NUM, 0xfb);
+        put_be(w, CBOR_NUM, bits64, 8);
+    }
+    put_byte(w, MSGPACK_NUM, single ? 0xca : 0xcb);
+    put_be(w, MSGPACK_NUM, single ? bits32 : bits64, single ? 4 : 8);
+}
+
+static void w_pair(writer_t *w, const char *key, const char *number)
+{
+    w_key(w, key);
+    w_number(w, number);
+}
+
+typedef struct {
+    const char *name;
+    writer_t w;
+    json_program_t program;
+} payload_t;
+
+enum { INFO, POWER, LIST, NUM_PAYLOADS };
+static payload_t payloads[NUM_PAYLOADS];
+
+#define LIST_ITEM(member) offsetof(list_widget_data_t, items) + offsetof(list_item_t, member)
+
+static const json_field_t info_fields[] = {
+    { "value", JSON_FIELD_SCALAR, offsetof(info_card_data_t, value), 64 },
+    { "unit", JSON_FIELD_STRING, offsetof(info_card_data_t, unit), 16 },
+};
+static const json_field_t power_fields[] = {
+    { "$.ENERGY.Power", JSON_FIELD_SCALAR, offsetof(info_card_data_t, value), 64 },
+};
+static const json_field_t list_fields[] = {
+    { "items[]", JSON_FIELD_COUNT, offsetof(list_widget_data_t, num_items), 0, 0, 10 },
+    { "items[].label", JSON_FIELD_STRING, LIST_ITEM(label), 32, sizeof(list_item_t), 10 },
+    { "items[].value", JSON_FIELD_SCALAR, LIST_ITEM(value), 64, sizeof(list_item_t), 10 },
+};
+
+static void compile(json_program_t *program, const json_field_t *fields, int n)
+{
+    json_program_init(program);
+    for (int i = 0; i < n; i++) {
+        BENCH_CHECK(json_program_add(program, &fields[i]));
+    }
+}
+
+static void make_payloads(void)
+{
+    writer_t *w = &payloads[INFO].w;
+    payloads[INFO].name = "info card";
+    w_open(w, true, 2);
+    w_pair(w, "value", "21.5");
+    w_key(w, "unit");
+    w_string(w, "C");
+    w_close(w);
+    compile(&payloads[INFO].program, info_fields, 2);
+
+    w = &payloads[POWER].w;
+    payloads[POWER].name = "tasmota";
+    w_open(w, true, 2);
+    w_key(w, "Time");
+    w_string(w, "2026-10-19T08:15:02");
+    w_key(w, "ENERGY");
+    w_open(w, true, 10);
+    w_key(w, "TotalStartTime");
+    w_string(w, "2026-01-02T10:00:00");
+    w_pair(w, "Total", "1234.567");
+    w_pair(w, "Yesterday", "3.21");
+    w_pair(w, "Today", "1.08");
+    w_pair(w, "Power", "482");
+    w_pair(w, "ApparentPower", "511");
+    w_pair(w, "ReactivePower", "168");
+    w_pair(w, "Factor", "0.94");
+    w_pair(w, "Voltage", "229");
+    w_pair(w, "Current", "2.226");
+    w_close(w);
+    w_close(w);
+    compile(&payloads[POWER].program, power_fields, 1);
+
+    w = &payloads[LIST].w;
+    payloads[LIST].name = "list";
+    w_open(w, true, 1);
+    w_key(w, "items");
+    w_open(w, false, 10);
+    for (int i = 0; i < 10; i++) {
+        char label[16], value[16];
+        snprintf(label, sizeof(label), "Room %d", i);
+        // Shortest form: a binary 18.0 comes out as "18", like any number
+        snprintf(value, sizeof(value), "%g", round((18 + i * 0.7) * 10) / 10);
+        w_open(w, true, 2);
+        w_key(w, "label");
+        w_string(w, label);
+        w_pair(w, "value", value);
+        w_close(w);
+    }
+    w_close(w);
+    w_close(w);
+    compile(&payloads[LIST].program, list_fields, 3);
+}
+
+static bool extract(const payload_t *p, int e, widget_data_t *out, uint32_t *changed)
+{
+    return payload_extract(encodings[e], (const char *)p->w.buf[e], p->w.len[e], &p->program, out, changed);
+}
+
+// Every encoding extracts to the same widget data as JSON with strings
+static void check_payloads(void)
+{
+    for (int i = 0; i < NUM_PAYLOADS; i++) {
+        widget_data_t want, got;
+        uint32_t changed;
+        memset(&want, 0, sizeof(want));
+        BENCH_CHECK(extract(&payloads[i], JSON_STR, &want, &changed) && changed != 0);
+        for (int e = 0; e < NUM_ENCODINGS; e++) {
+            memset(&got, 0, sizeof(got));
+            BENCH_CHECK(extract(&payloads[i], e, &got, &changed));
+            if (memcmp(&want, &got, sizeof(want)) != 0) {
+                fprintf(stderr, "%s: %s extracts differently\n", payloads[i].name, encoding_names[e]);
+                exit(1);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = bench_quick(argc, argv);
+    make_payloads();
+    check_payloads();
+
+    long iters = quick ? 100 : 400000;
+    static widget_data_t out;
+    uint32_t changed;
+    printf("%s; vs JSON: against JSON with strings\n", quick ? "quick check" : "best of 5");
+    for (int i = 0; i < NUM_PAYLOADS; i++) {
+        const payload_t *p = &payloads[i];
+        printf("  %s\n", p->name);
+        double json_ns = 0;
+        for (int e = 0; e < NUM_ENCODINGS; e++) {
+            double ns;
+            BENCH_BEST_NS(ns, quick ? 1 : 5, iters, extract(p, e, &out, &changed));
+            if (e == JSON_STR) json_ns = ns;
+            printf("    %-13s %4zu B %+4.0f%%  %7.1f ns/msg  %4.2fx\n", encoding_names[e], p->w.len[e],
+                   100.0 * ((double)p->w.len[e] / p->w.len[JSON_STR] - 1), ns, json_ns / ns);
+        }
+    }
+    return 0;
+}
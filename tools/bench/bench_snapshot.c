@@ -0,0 +1,126 @@
+// Snapshot placement on a file-backed 16-sector partition. Saves of 1, 8
+// and 8 sectors (incompressible frames, like dithered images) make the last
+// one wrap around the end of the partition. Every save is repeated with the
+// power cut after each of its flash writes in turn: a remount must then
+// still load the snapshot before it. Reports save and load times.
+#include "bench.h"
+#include "histlog.h"
+#include "rle.h"
+#include "snapshot.h"
+
+#define SECTORS 16
+#define MAX_FRAME (8 * SNAPSHOT_SECTOR_SIZE)
+
+static histlog_flash_t file_flash;
+static int writes_left;     // writes before the simulated power cut, -1 for none
+
+static bool cut_read(void *ctx, size_t offset, void *buf, size_t len)
+{
+    return file_flash.read(ctx, offset, buf, len);
+}
+
+static bool cut_write(void *ctx, size_t offset, const void *buf, size_t len)
+{
+    if (writes_left == 0) return false;
+    if (writes_left > 0) writes_left--;
+    return file_flash.write(ctx, offset, buf, len);
+}
+
+static bool cut_erase(void *ctx, size_t offset, size_t len)
+{
+    return writes_left != 0 && file_flash.erase(ctx, offset, len);
+}
+
+static histlog_flash_t cut_flash(void)
+{
+    histlog_flash_t flash = file_flash;
+    flash.read = cut_read;
+    flash.write = cut_write;
+    flash.erase = cut_erase;
+    return flash;
+}
+
+static uint8_t frames[3][MAX_FRAME];
+static size_t frame_lens[3];
+static uint8_t loaded[MAX_FRAME];
+
+// Longest random frame whose snapshot takes exactly sectors sectors
+static size_t fill_frame(uint8_t *frame, int sectors)
+{
+    for (size_t i = 0; i < MAX_FRAME; i++) frame[i] = (uint8_t)rand();
+    size_t len = (size_t)sectors * SNAPSHOT_SECTOR_SIZE;
+    while (len > 0 && rle_encoded_size(frame, len) + 64 > (size_t)sectors * SNAPSHOT_SECTOR_SIZE) len -= 16;
+    BENCH_CHECK(rle_encoded_size(frame, len) + 32 > (size_t)(sectors - 1) * SNAPSHOT_SECTOR_SIZE);
+    return len;
+}
+
+// Remount as after a reset and check the newest snapshot is frame f
+static void check_loads(int f)
+{
+    histlog_flash_t flash = cut_flash();
+    writes_left = -1;
+    BENCH_CHECK(snapshot_mount(&flash));
+    uint32_t page = 0;
+    BENCH_CHECK(snapshot_load(1, &page, loaded, frame_lens[f], NULL, 0));
+    BENCH_CHECK(page == (uint32_t)f && memcmp(loaded, frames[f], frame_lens[f]) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = bench_quick(argc, argv);
+    const char *path = "bench_snapshot.bin";
+    remove(path);
+    BENCH_CHECK(histlog_flash_file(&file_flash, path, SECTORS * SNAPSHOT_SECTOR_SIZE));
+
+    static const int sizes[3] = { 1, 8, 8 };
+    srand(3);
+    for (int f = 0; f < 3; f++) {
+        frame_lens[f] = fill_frame(frames[f], sizes[f]);
+    }
+
+    histlog_flash_t flash = cut_flash();
+    writes_left = -1;
+    BENCH_CHECK(snapshot_mount(&flash));
+    BENCH_CHECK(snapshot_save(1, 0, frames[0], frame_lens[0], NULL, 0));
+    check_loads(0);
+
+    for (int f = 1; f < 3; f++) {
+        // Cut the power after 0, 1, ... writes until the save gets through
+        for (int cut = 0;; cut++) {
+            flash = cut_flash();
+            writes_left = -1;
+            BENCH_CHECK(snapshot_mount(&flash));
+            writes_left = cut;
+            bool saved = snapshot_save(1, (uint32_t)f, frames[f], frame_lens[f], NULL, 0);
+            check_loads(saved ? f : f - 1);
+            if (saved) break;
+        }
+    }
+
+    // Alternate two frames so every save is written; sizes 8 and 8 keep wrapping
+    int rounds = quick ? 2 : 50;
+    writes_left = -1;
+    flash = cut_flash();
+    BENCH_CHECK(snapshot_mount(&flash));
+    int64_t t0 = bench_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        BENCH_CHECK(snapshot_save(1, (uint32_t)(1 + r % 2), frames[1 + r % 2], frame_lens[1 + r % 2], NULL, 0));
+    }
+    double save_ms = (double)(bench_now_ns() - t0) / 1e6 / rounds;
+    int f = 1 + (rounds - 1) % 2;
+    uint32_t page;
+    t0 = bench_now_ns();
+    for (int r = 0; r < rounds; r++) {
+        BENCH_CHECK(snapshot_load(1, &page, loaded, frame_lens[f], NULL, 0));
+    }
+    double load_ms = (double)(bench_now_ns() - t0) / 1e6 / rounds;
+    BENCH_CHECK(memcmp(loaded, frames[f], frame_lens[f]) == 0);
+
+    snapshot_stats_t stats;
+    snapshot_get_stats(&stats);
+    printf("%d sectors, %u-byte snapshots: save %.2f ms, load %.2f ms (file backend)\n", SECTORS,
+           (unsigned)stats.last_bytes, save_ms, load_ms);
+    fclose((FILE *)file_flash.ctx);
+    remove(path);
+    return 0;
+}
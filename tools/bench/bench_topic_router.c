@@ -0,0 +1,136 @@
+// Topic routing: filter validation, overlap and matching rules first, then matching
+// cost per message as a dashboard grows from 10 to 400 widgets. Most widgets
+// subscribe to one exact topic; a fixed handful use wildcard filters.
+#include "bench.h"
+#include "topic_router.h"
+
+#define MAX_WIDGETS 400
+#define NUM_WILDCARDS 4
+
+static widget_config_t widgets[MAX_WIDGETS];
+static char topics[MAX_WIDGETS][48];
+static app_config_t config;
+
+static void check_filters(void)
+{
+    static const struct {
+        const char *filter;
+        bool valid;
+    } cases[] = {
+        { "home/kitchen/temp", true }, { "home/+/temp", true }, { "home/#", true },
+        { "#", true }, { "+", true }, { "+/+", true }, { "/", true }, { "home//temp", true },
+        { "", false }, { "home/kit+/temp", false }, { "home/+kitchen", false },
+        { "home/#/temp", false }, { "home/te#", false }, { "##", false }, { "#/", false },
+        { "home/++", false },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (topic_router_filter_valid(cases[i].filter) != cases[i].valid) {
+            fprintf(stderr, "filter '%s' should be %s\n", cases[i].filter, cases[i].valid ? "valid" : "rejected");
+            exit(1);
+        }
+    }
+}
+
+static void check_overlaps(void)
+{
+    static const struct {
+        const char *a, *b;
+        bool overlap;
+    } cases[] = {
+        { "a/b", "a/b", true }, { "a/b", "a/c", false }, { "a/+", "a/b", true },
+        { "+/b", "a/+", true }, { "a/#", "a", true }, { "a/#", "a/b/c", true },
+        { "a/+", "a", false }, { "a/b", "a/b/c", false }, { "#", "x/y", true },
+        { "#", "$SYS/x", false }, { "+/x", "$SYS/x", false }, { "$SYS/#", "$SYS/x", true },
+        { "a/+/c", "a/b/d", false },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        // Symmetric
+        if (topic_router_filters_overlap(cases[i].a, cases[i].b) != cases[i].overlap ||
+            topic_router_filters_overlap(cases[i].b, cases[i].a) != cases[i].overlap) {
+            fprintf(stderr, "'%s' and '%s' should %soverlap\n", cases[i].a, cases[i].b, cases[i].overlap ? "" : "not ");
+            exit(1);
+        }
+    }
+}
+
+static int match(const char *topic, uint16_t *out)
+{
+    return topic_router_match(topic, strlen(topic), out, TOPIC_ROUTER_MAX_FANOUT);
+}
+
+static void build(const char *const *filters, int n, const char *batch_topic)
+{
+    memset(&config, 0, sizeof(config));
+    for (int i = 0; i < n; i++) {
+        widgets[i] = (widget_config_t){ .topic = filters[i], .qos = 1 };
+    }
+    config.widgets = widgets;
+    config.num_widgets = n;
+    strncpy(config.mqtt.batch_topic, batch_topic, sizeof(config.mqtt.batch_topic) - 1);
+    BENCH_CHECK(topic_router_build(&config));
+}
+
+static void check_rules(void)
+{
+    static const char *const filters[] = {
+        "a/b", "a/+", "a/#", "+/b", "a/b", "#", "a/+x", "",
+    };
+    uint16_t out[TOPIC_ROUTER_MAX_FANOUT];
+    build(filters, 8, "batch");
+
+    // "a/b" twice, "a/+", "a/#", "+/b" and "#"; the malformed "a/+x" is skipped
+    BENCH_CHECK(match("a/b", out) == 6);
+    // "a/#" also matches its parent level
+    BENCH_CHECK(match("a", out) == 2);
+    BENCH_CHECK(match("a/b/c", out) == 2);
+    // Wildcards at the first level skip '$' topics
+    BENCH_CHECK(match("$SYS/b", out) == 0);
+    BENCH_CHECK(match("batch", out) == 2 && out[0] + out[1] == 8 + 5);
+    // The duplicate is merged, the empty and malformed filters left out
+    BENCH_CHECK(topic_router_filter_count() == 6);
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = bench_quick(argc, argv);
+    check_filters();
+    check_overlaps();
+    check_rules();
+
+    static const char *const wildcards[NUM_WILDCARDS] = {
+        "home/+/battery", "alerts/#", "+/status", "home/garden/+",
+    };
+    const char *filters[MAX_WIDGETS];
+    for (int i = 0; i < MAX_WIDGETS; i++) {
+        if (i < NUM_WILDCARDS) {
+            filters[i] = wildcards[i];
+        } else {
+            snprintf(topics[i], sizeof(topics[i]), "home/room%d/sensor%d", i / 8, i % 8);
+            filters[i] = topics[i];
+        }
+    }
+
+    static const int sizes[] = { 10, 50, 100, 400 };
+    long iters = quick ? 1000 : 2000000;
+    uint16_t out[TOPIC_ROUTER_MAX_FANOUT];
+    volatile int sink = 0;
+
+    printf("%d wildcard filters, %s\n", NUM_WILDCARDS, quick ? "quick check" : "best of 5");
+    printf("  widgets   exact hit  wildcard hit        miss\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int n = sizes[s];
+        build(filters, n, "");
+        const char *exact = topics[n - 1];
+        BENCH_CHECK(match(exact, out) == 1 && out[0] == n - 1);
+        BENCH_CHECK(match("home/room3/battery", out) == 1);
+        BENCH_CHECK(match("home/room3/unknown", out) == 0);
+
+        double exact_ns, wild_ns, miss_ns;
+        BENCH_BEST_NS(exact_ns, quick ? 1 : 5, iters, sink += match(exact, out));
+        BENCH_BEST_NS(wild_ns, quick ? 1 : 5, iters, sink += match("home/room3/battery", out));
+        BENCH_BEST_NS(miss_ns, quick ? 1 : 5, iters, sink += match("home/room3/unknown", out));
+        printf("  %7d %8.1f ns %10.1f ns %8.1f ns\n", n, exact_ns, wild_ns, miss_ns);
+    }
+    (void)sink;
+    return 0;
+}